@@ -39,6 +39,24 @@ LICENSE
 #include <xmmintrin.h>
 #endif
 
+/* The SSE2 kernels are only compiled if the compiler targets SSE2 (always on x86_64). 32 bit builds for
+ * CPUs without SSE2 keep the SSE vertex math and use the scalar kernels.
+ */
+#if defined(CSR_USE_SSE) && (defined(__SSE2__) || defined(__x86_64__))
+#include <emmintrin.h>
+#include <stddef.h> /* size_t, alignment of streaming stores */
+#define CSR_HAS_SSE2
+#endif
+
+/* With the SSE2 kernels the AVX2 kernels are compiled as well (GCC/Clang only) and used if the CPU
+ * supports them. Define CSR_NO_AVX2 to leave them out.
+ */
+#if defined(CSR_HAS_SSE2) && (defined(__GNUC__) || defined(__clang__)) && !defined(CSR_NO_AVX2)
+#include <immintrin.h>
+#define CSR_HAS_AVX2
+#define CSR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
 /* #############################################################################
  * # MATRIX LAYOUT
  * #############################################################################
@@ -66,6 +84,11 @@ CSR_API CSR_INLINE float csr_maxf(float a, float b)
   return (a > b) ? a : b;
 }
 
+CSR_API CSR_INLINE float csr_absf(float x)
+{
+  return (x < 0.0f ? -x : x);
+}
+
 CSR_API CSR_INLINE int csr_absi(int x)
 {
   return (x < 0 ? -x : x);
@@ -81,6 +104,46 @@ CSR_API CSR_INLINE int csr_maxi(int a, int b)
   return (a > b) ? a : b;
 }
 
+/* Square root for setup code, not meant for per pixel work. */
+CSR_API CSR_INLINE float csr_sqrtf(float x)
+{
+#ifdef CSR_USE_SSE
+  return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(csr_maxf(x, 0.0f))));
+#else
+  float r = x > 1.0f ? x : 1.0f;
+  int i;
+
+  if (x <= 0.0f)
+  {
+    return 0.0f;
+  }
+
+  /* Newton iterations decrease monotonically from above the root until they stop improving */
+  for (i = 0; i < 128; ++i)
+  {
+    float next = 0.5f * (r + x / r);
+
+    if (next >= r)
+    {
+      break;
+    }
+
+    r = next;
+  }
+
+  return r;
+#endif
+}
+
+/* Returns the number of set bits of an 8 bit mask. */
+CSR_API CSR_INLINE int csr_bit_count8(int bits)
+{
+  bits = bits - ((bits >> 1) & 0x55);
+  bits = (bits & 0x33) + ((bits >> 2) & 0x33);
+
+  return (bits + (bits >> 4)) & 0x0f;
+}
+
 CSR_API CSR_INLINE void csr_pos_init(float *pos, float x, float y, float z, float w)
 {
   pos[0] = x;
@@ -140,6 +203,111 @@ CSR_API CSR_INLINE void csr_m4x4_mul_v4(float result[4], float m[16], float v[4]
 #endif
 }
 
+/* Transforms count object space positions (SoA, w = 1) to clip space (SoA) one at a time. */
+CSR_API CSR_INLINE void csr_kernel_transform_scalar(float m[16], float *positions[3], float *clip[4], int count)
+{
+  int i, row;
+
+  for (i = 0; i < count; ++i)
+  {
+    float x = positions[0][i];
+    float y = positions[1][i];
+    float z = positions[2][i];
+
+    for (row = 0; row < 4; ++row)
+    {
+      clip[row][i] = m[CSR_M4X4_AT(row, 0)] * x + m[CSR_M4X4_AT(row, 1)] * y + m[CSR_M4X4_AT(row, 2)] * z + m[CSR_M4X4_AT(row, 3)];
+    }
+  }
+}
+
+#ifdef CSR_HAS_SSE2
+/* Transforms 4 positions per iteration, the remainder is handled by the scalar kernel. */
+CSR_API CSR_INLINE void csr_kernel_transform_sse2(float m[16], float *positions[3], float *clip[4], int count)
+{
+  __m128 mat[16];
+  float *positions_tail[3];
+  float *clip_tail[4];
+  int i, row;
+
+  for (i = 0; i < 16; ++i)
+  {
+    mat[i] = _mm_set1_ps(m[CSR_M4X4_AT(i / 4, i % 4)]);
+  }
+
+  for (i = 0; i + 4 <= count; i += 4)
+  {
+    __m128 x = _mm_loadu_ps(&positions[0][i]);
+    __m128 y = _mm_loadu_ps(&positions[1][i]);
+    __m128 z = _mm_loadu_ps(&positions[2][i]);
+
+    for (row = 0; row < 4; ++row)
+    {
+      __m128 res = _mm_mul_ps(mat[row * 4 + 0], x);
+      res = _mm_add_ps(res, _mm_mul_ps(mat[row * 4 + 1], y));
+      res = _mm_add_ps(res, _mm_mul_ps(mat[row * 4 + 2], z));
+      res = _mm_add_ps(res, mat[row * 4 + 3]);
+
+      _mm_storeu_ps(&clip[row][i], res);
+    }
+  }
+
+  positions_tail[0] = positions[0] + i;
+  positions_tail[1] = positions[1] + i;
+  positions_tail[2] = positions[2] + i;
+  clip_tail[0] = clip[0] + i;
+  clip_tail[1] = clip[1] + i;
+  clip_tail[2] = clip[2] + i;
+  clip_tail[3] = clip[3] + i;
+
+  csr_kernel_transform_scalar(m, positions_tail, clip_tail, count - i);
+}
+#endif
+
+#ifdef CSR_HAS_AVX2
+/* Transforms 8 positions per iteration, the remainder is handled by the scalar kernel. */
+CSR_API CSR_INLINE CSR_TARGET_AVX2 void csr_kernel_transform_avx2(float m[16], float *positions[3], float *clip[4], int count)
+{
+  __m256 mat[16];
+  float *positions_tail[3];
+  float *clip_tail[4];
+  int i, row;
+
+  for (i = 0; i < 16; ++i)
+  {
+    mat[i] = _mm256_set1_ps(m[CSR_M4X4_AT(i / 4, i % 4)]);
+  }
+
+  for (i = 0; i + 8 <= count; i += 8)
+  {
+    __m256 x = _mm256_loadu_ps(&positions[0][i]);
+    __m256 y = _mm256_loadu_ps(&positions[1][i]);
+    __m256 z = _mm256_loadu_ps(&positions[2][i]);
+
+    /* No FMA on purpose, the results stay bit identical to the scalar and SSE2 kernels */
+    for (row = 0; row < 4; ++row)
+    {
+      __m256 res = _mm256_mul_ps(mat[row * 4 + 0], x);
+      res = _mm256_add_ps(res, _mm256_mul_ps(mat[row * 4 + 1], y));
+      res = _mm256_add_ps(res, _mm256_mul_ps(mat[row * 4 + 2], z));
+      res = _mm256_add_ps(res, mat[row * 4 + 3]);
+
+      _mm256_storeu_ps(&clip[row][i], res);
+    }
+  }
+
+  positions_tail[0] = positions[0] + i;
+  positions_tail[1] = positions[1] + i;
+  positions_tail[2] = positions[2] + i;
+  clip_tail[0] = clip[0] + i;
+  clip_tail[1] = clip[1] + i;
+  clip_tail[2] = clip[2] + i;
+  clip_tail[3] = clip[3] + i;
+
+  csr_kernel_transform_scalar(m, positions_tail, clip_tail, count - i);
+}
+#endif
+
 /* #############################################################################
  * # RENDERING Functions
  * #############################################################################
@@ -155,7 +323,9 @@ typedef struct csr_color
 typedef enum csr_render_mode
 {
   CSR_RENDER_SOLID = 0,
-  CSR_RENDER_WIREFRAME = 1
+  CSR_RENDER_WIREFRAME = 1,
+  CSR_RENDER_DEPTH_ONLY = 2, /* Depth prepass: writes the zbuffer only                                  */
+  CSR_RENDER_DEPTH_EQUAL = 3 /* Color pass after a prepass: colors pixels whose depth equals the zbuffer */
 
 } csr_render_mode;
 
@@ -170,346 +340,4921 @@ typedef enum csr_culling_mode
 
 } csr_culling_mode;
 
-typedef struct csr_context
+typedef enum csr_frustum_result
 {
+  CSR_FRUSTUM_OUTSIDE = 0,    /* Nothing of the box can be visible                                 */
+  CSR_FRUSTUM_INTERSECTS = 1, /* The box crosses the screen border or the camera plane             */
+  CSR_FRUSTUM_INSIDE = 2      /* The box is in front of the camera and projects inside the screen */
 
-  int width;              /* render area width in pixels            */
-  int height;             /* render area height in pixels           */
-  csr_color *framebuffer; /* memory pointer for framebuffer         */
-  float *zbuffer;         /* memory pointer for zbuffer             */
+} csr_frustum_result;
 
-} csr_context;
+/* #############################################################################
+ * # TILE BINNING SETTINGS
+ * #############################################################################
+ */
+/* The screen is split into CSR_TILE_SIZE x CSR_TILE_SIZE tiles. csr_render sets up
+ * each triangle once, bins it into every tile its bounding box touches and then
+ * rasterizes tile by tile so that the color and depth of a tile stay in cache.
+ */
+#define CSR_TILE_SIZE 64
 
-CSR_API CSR_INLINE unsigned long csr_memory_size(int width, int height)
-{
-  unsigned long area = (unsigned long)(width * height);
+/* Max. number of set up triangles kept before the bins are flushed */
+#ifndef CSR_TRIANGLE_BATCH_SIZE
+#define CSR_TRIANGLE_BATCH_SIZE 1024
+#endif
 
-  return (unsigned long)(area * (unsigned long)sizeof(csr_color) + /* framebuffer size */
-                         area * (unsigned long)sizeof(float)       /* zbuffer size     */
-  );
-}
+/* Max. number of (tile, triangle) references kept before the bins are flushed */
+#ifndef CSR_BIN_ENTRIES_MAX
+#define CSR_BIN_ENTRIES_MAX 16384
+#endif
 
-CSR_API CSR_INLINE int csr_init_model(csr_context *context, void *memory, unsigned long memory_size, int width, int height)
-{
-  unsigned long memory_framebuffer_size = (unsigned long)(width * height) * (unsigned long)sizeof(csr_color);
+/* #############################################################################
+ * # RASTERIZER SETTINGS
+ * #############################################################################
+ */
+/* Vertices are snapped to 28.4 sub-pixel fixed point and covered pixels are found with
+ * integer edge functions using the top-left fill rule, so pixels on an edge shared by two
+ * triangles are drawn exactly once.
+ */
+#define CSR_SUBPIXEL_BITS 4
+#define CSR_SUBPIXEL_STEPS (1 << CSR_SUBPIXEL_BITS)
 
-  if (memory_size < csr_memory_size(width, height))
-  {
-    return 0;
-  }
+/* Triangles with a vertex further than this many pixels away from the screen origin are
+ * discarded. It keeps the edge functions of any 64x64 pixel rectangle within 32 bits.
+ */
+#define CSR_GUARD_BAND 16384.0f
 
-  context->width = width;
-  context->height = height;
-  context->framebuffer = (csr_color *)memory;
-  context->zbuffer = (float *)((char *)memory + memory_framebuffer_size);
+/* Rectangles are classified in CSR_BLOCK_SIZE x CSR_BLOCK_SIZE blocks aligned to the screen.
+ * Blocks outside of an edge are skipped, pixels of fully covered blocks are drawn without
+ * coverage tests and only partially covered blocks test every pixel.
+ */
+#define CSR_BLOCK_SIZE 8
+#define CSR_BLOCK_ROWS_MAX (CSR_TILE_SIZE / CSR_BLOCK_SIZE + 1)
 
-  return 1;
-}
+/* Only rectangles with more pixels than this are classified in blocks, smaller ones test every pixel */
+#ifndef CSR_BLOCK_CLASSIFY_MIN_PIXELS
+#define CSR_BLOCK_CLASSIFY_MIN_PIXELS 256
+#endif
 
-CSR_API CSR_INLINE csr_color csr_init_color(unsigned char r, unsigned char g, unsigned char b)
-{
-  csr_color result;
-  result.r = r;
-  result.g = g;
-  result.b = b;
+/* With binning memory the context keeps the max. depth of every block and tile (hierarchical
+ * depth). Rectangles and blocks whose nearest depth is not closer than the farthest stored
+ * depth are skipped without touching their pixels.
+ */
+#define CSR_BLOCKS_PER_TILE (CSR_TILE_SIZE / CSR_BLOCK_SIZE)
 
-  return result;
-}
+/* Max. depth of blocks whose depth values are unknown (before the first clear) */
+#define CSR_DEPTH_UNKNOWN 3.4e38f
 
-/* Converts a point from normalized device coordinates(NDC) to screen space. */
-CSR_API CSR_INLINE void csr_ndc_to_screen(csr_context *context, float result[3], float ndc_pos[4])
-{
-  result[0] = (ndc_pos[0] + 1.0f) * 0.5f * (float)context->width;
-  result[1] = (1.0f - ndc_pos[1]) * 0.5f * (float)context->height;
-  result[2] = ndc_pos[2];
-}
+/* Depth bounds are widened by this fraction of the depth magnitudes to cover float rounding in the kernels */
+#ifndef CSR_HIZ_TOLERANCE
+#define CSR_HIZ_TOLERANCE (1.0f / 131072.0f)
+#endif
 
-CSR_API CSR_INLINE void csr_render_clear_screen(csr_context *context, csr_color clear_color)
-{
-  int size = context->width * context->height;
+/* Smaller rectangles are only tested against the tile max. depth, testing their blocks costs about as much as drawing them */
+#ifndef CSR_HIZ_MIN_PIXELS
+#define CSR_HIZ_MIN_PIXELS 64
+#endif
 
-  int i = 0;
+/* Boxes tested by csr_occlusion_test_aabb count as visible if their nearest depth is less than this fraction
+ * of its magnitude behind the stored depth. With SSE the perspective divide uses an approximate reciprocal,
+ * so the depth of a vertex can be up to about 1/2730 of its magnitude lower than the exact one.
+ */
+#ifndef CSR_OCCLUSION_TOLERANCE
+#ifdef CSR_USE_SSE
+#define CSR_OCCLUSION_TOLERANCE (1.0f / 2048.0f)
+#else
+#define CSR_OCCLUSION_TOLERANCE (1.0f / 65536.0f)
+#endif
+#endif
 
-  for (; i + 4 <= size; i += 4)
-  {
-    context->framebuffer[i] = clear_color;
-    context->framebuffer[i + 1] = clear_color;
-    context->framebuffer[i + 2] = clear_color;
-    context->framebuffer[i + 3] = clear_color;
-    context->zbuffer[i] = 1.0f;
-    context->zbuffer[i + 1] = 1.0f;
-    context->zbuffer[i + 2] = 1.0f;
-    context->zbuffer[i + 3] = 1.0f;
-  }
+/* Overdraw heatmaps (see csr_heatmap_overdraw) show this many depth tested pixels per pixel and more in red */
+#ifndef CSR_OVERDRAW_HEATMAP_MAX
+#define CSR_OVERDRAW_HEATMAP_MAX 8
+#endif
 
-  for (; i < size; ++i)
-  {
-    context->framebuffer[i] = clear_color;
-    context->zbuffer[i] = 1.0f;
-  }
-}
+/* Define CSR_ENABLE_STATS before including this file to count the work of every pipeline stage per worker
+ * (see csr_stats_collect). Without it the counters are compiled out and the kernels stay unchanged.
+ */
+#define CSR_STATS_AREA_BINS 16
 
-/* Draws a line with depth testing using Bresenham's algorithm. */
-CSR_API CSR_INLINE void csr_draw_line(csr_context *context, float p0[3], float p1[3], csr_color color)
+typedef struct csr_stats
 {
-  int x0 = (int)p0[0], y0 = (int)p0[1];
-  int x1 = (int)p1[0], y1 = (int)p1[1];
-  float z0 = p0[2], z1 = p1[2];
+  unsigned long meshes_submitted;     /* meshes handed to csr_render_mesh                              */
+  unsigned long meshes_culled;        /* meshes whose bounding box is outside of the frustum           */
+  unsigned long triangles_submitted;  /* triangles of the meshes that were not culled                  */
+  unsigned long triangles_w_rejected; /* with a vertex behind the camera                              */
+  unsigned long triangles_culled;     /* removed by the culling mode (winding order)                  */
+  unsigned long triangles_degenerate; /* zero area after snapping to the sub-pixel grid               */
+  unsigned long triangles_offscreen;  /* outside of the screen or the guard band                      */
+  unsigned long triangles_rasterized; /* set up and handed to the rasterizer                          */
+  unsigned long pixels_bbox;          /* pixels of the bounding box parts handed to the rasterizer    */
+  unsigned long pixels_visited;       /* pixels whose coverage was tested (not skipped by blocks)     */
+  unsigned long pixels_covered;       /* pixels inside of the triangle, these are depth tested        */
+  unsigned long pixels_passed;        /* pixels that passed the depth test                            */
+  unsigned long pixels_written;       /* pixels whose color (or visibility id) was written            */
 
-  int dx = csr_absi(x1 - x0);
-  int sx = x0 < x1 ? 1 : -1;
-  int dy = -csr_absi(y1 - y0);
-  int sy = y0 < y1 ? 1 : -1;
+  /* Rasterized triangles by their area in pixels: bin 0 below 1 pixel, bin i from 2^(i - 1) to 2^i pixels and
+   * the last bin everything larger
+   */
+  unsigned long triangle_areas[CSR_STATS_AREA_BINS];
 
-  int err = dx + dy, e2;
-  float z = z0;
-  float dz = (float)(dx > -dy ? dx : -dy);
+} csr_stats;
 
-  dz = (dz == 0) ? 0.0f : (z1 - z0) / dz;
+#ifdef CSR_ENABLE_STATS
+#define CSR_STATS_ADD(stats, counter, value) ((stats)->counter += (unsigned long)(value))
+#else
+#define CSR_STATS_ADD(stats, counter, value) ((void)0)
+#endif
 
-  while (1)
-  {
-    if (x0 >= 0 && x0 < context->width && y0 >= 0 && y0 < context->height)
-    {
-      int index = y0 * context->width + x0;
+/* Define CSR_ENABLE_TIMINGS before including this file and set csr_context.timer to a cycle counter (e.g.
+ * perf_platform_current_cycle_count of perf.h) to sum the cycles spent per stage of the triangle pipeline
+ * in csr_context.stage_cycles. The timer is read when a stage ends, not per pixel, and only on the calling
+ * thread, so the raster stage is the wall clock time of all workers.
+ */
+typedef enum csr_stage
+{
+  CSR_STAGE_TRANSFORM = 0, /* vertex transform, perspective divide and viewport transform                */
+  CSR_STAGE_CULL,          /* frustum, camera plane and winding order culling                          */
+  CSR_STAGE_SETUP,         /* triangle setup and tile binning                                          */
+  CSR_STAGE_RASTER,        /* rasterization and depth testing of the set up triangles                  */
+  CSR_STAGE_LINES,         /* wireframe lines                                                          */
+  CSR_STAGE_COUNT
 
-      if (z < context->zbuffer[index])
-      {
-        context->framebuffer[index] = color;
-        context->zbuffer[index] = z;
-      }
-    }
+} csr_stage;
 
-    if (x0 == x1 && y0 == y1)
-    {
-      break;
-    }
+typedef unsigned long (*csr_timer_function)(void);
 
-    e2 = 2 * err;
+#ifdef CSR_ENABLE_TIMINGS
+#define CSR_TIMER_START(context) csr_timer_start(context)
+#define CSR_TIMER_LAP(context, stage) csr_timer_lap((context), (stage))
+#define CSR_TIMER_STOP(context, started) csr_timer_stop((context), (started))
+#else
+#define CSR_TIMER_START(context) 0
+#define CSR_TIMER_LAP(context, stage) ((void)0)
+#define CSR_TIMER_STOP(context, started) ((void)(started))
+#endif
 
-    if (e2 >= dy)
-    {
-      err += dy;
-      x0 += sx;
-      z += dz;
-    }
+/* Visibility buffer ids are 32 bit: the draw (index in the command buffer) in the upper bits and the
+ * triangle (index / 3 in its index list) in the lower CSR_VISIBILITY_TRIANGLE_BITS bits. The all ones id
+ * is reserved for CSR_VISIBILITY_EMPTY, so a buffer holds at most 2^(32 - CSR_VISIBILITY_TRIANGLE_BITS) - 1 draws.
+ */
+#ifndef CSR_VISIBILITY_TRIANGLE_BITS
+#define CSR_VISIBILITY_TRIANGLE_BITS 20
+#endif
 
-    if (e2 <= dx)
-    {
-      err += dx;
-      y0 += sy;
-      z += dz;
-    }
-  }
-}
+/* Id of pixels not covered by a triangle of the visibility pass */
+#define CSR_VISIBILITY_EMPTY 0xffffffffU
 
-/* Fills a triangle using the barycentric coordinate method with color interpolation. */
-CSR_API CSR_INLINE void csr_draw_triangle(csr_context *context, float p0[3], float p1[3], float p2[3], csr_color c0, csr_color c1, csr_color c2)
+/* Triangle data computed once in the setup stage and shared by all tiles it touches */
+typedef struct csr_triangle
 {
-  /* Bounding box for the triangle */
-  int min_x = (int)csr_minf(p0[0], csr_minf(p1[0], p2[0]));
-  int min_y = (int)csr_minf(p0[1], csr_minf(p1[1], p2[1]));
-  int max_x = (int)csr_maxf(p0[0], csr_maxf(p1[0], p2[0]));
-  int max_y = (int)csr_maxf(p0[1], csr_maxf(p1[1], p2[1]));
+  int min_x; /* screen clamped bounding box */
+  int min_y;
+  int max_x;
+  int max_y;
 
-  /* Pre-calculate constants for barycentric coordinates */
-  float area = (p1[1] - p2[1]) * (p0[0] - p2[0]) + (p2[0] - p1[0]) * (p0[1] - p2[1]);
+  /* Edge functions E(x, y) = a * x + b * y + c in 28.4 fixed point evaluated at pixel centers.
+   * The top-left fill rule bias is already part of c, so a pixel is covered if all E >= 0.
+   * c exceeds 32 bits for large triangles and is kept as an (exact) double.
+   */
+  int edge_a[3];
+  int edge_b[3];
+  double edge_c[3];
 
-  if (area == 0.0f)
-  {
-    return;
-  }
+  /* Depth range of the vertices and depth and color planes relative to the center of pixel (min_x, min_y) */
+  float z_min, z_max;
+  float z, z_dx, z_dy;
+  float r, r_dx, r_dy;
+  float g, g_dx, g_dy;
+  float b, b_dx, b_dy;
 
-  /* Clamp bounding box to screen dimensions */
-  min_x = csr_maxi(0, min_x);
-  min_y = csr_maxi(0, min_y);
-  max_x = csr_mini(context->width - 1, max_x);
-  max_y = csr_mini(context->height - 1, max_y);
+  unsigned int id; /* visibility buffer id */
 
-  {
-    float inv_area = 1.0f / area;
+} csr_triangle;
 
-    /* Calculate barycentric coordinate derivatives with respect to x and y */
-    float w0_dx = (p1[1] - p2[1]) * inv_area;
-    float w1_dx = (p2[1] - p0[1]) * inv_area;
-    float w2_dx = -w0_dx - w1_dx;
+/* Screen rectangle of a triangle handed to a raster kernel, advanced row by row */
+typedef struct csr_raster_rect
+{
+  int min_x; /* inclusive, at most CSR_TILE_SIZE x CSR_TILE_SIZE pixels */
+  int min_y;
+  int max_x;
+  int max_y;
 
-    float w0_dy = (p2[0] - p1[0]) * inv_area;
-    float w1_dy = (p0[0] - p2[0]) * inv_area;
-    float w2_dy = -w0_dy - w1_dy;
+  /* Edge functions at pixel (min_x, current row) and their per pixel / per row steps */
+  int e_row[3];
+  int e_dx[3];
+  int e_dy[3];
 
-    /* Initialize barycentric coordinates at the top-left of the bounding box */
-    float w0_start = ((p1[1] - p2[1]) * ((float)min_x - p2[0]) + (p2[0] - p1[0]) * ((float)min_y - p2[1])) * inv_area;
-    float w1_start = ((p2[1] - p0[1]) * ((float)min_x - p0[0]) + (p0[0] - p2[0]) * ((float)min_y - p0[1])) * inv_area;
-    float w2_start = 1.0f - w0_start - w1_start;
+  /* Attributes at pixel (min_x, current row) */
+  float z_row;
+  float r_row;
+  float g_row;
+  float b_row;
 
-    /* Pre-calculate color channel differences for interpolation */
-    float dr_dx = (c1.r - c0.r) * w1_dx + (c2.r - c0.r) * w2_dx;
-    float dg_dx = (c1.g - c0.g) * w1_dx + (c2.g - c0.g) * w2_dx;
-    float db_dx = (c1.b - c0.b) * w1_dx + (c2.b - c0.b) * w2_dx;
+  /* Per block row the pixels of the blocks touching the triangle and the fully covered part of
+   * them. Empty ranges have min > max. Index 0 is the block row containing min_y. Rectangles
+   * that were not classified have a single span for all rows.
+   */
+  int classified;
+  int span_min_x[CSR_BLOCK_ROWS_MAX];
+  int span_max_x[CSR_BLOCK_ROWS_MAX];
+  int covered_min_x[CSR_BLOCK_ROWS_MAX];
+  int covered_max_x[CSR_BLOCK_ROWS_MAX];
 
-    float dr_dy = (c1.r - c0.r) * w1_dy + (c2.r - c0.r) * w2_dy;
-    float dg_dy = (c1.g - c0.g) * w1_dy + (c2.g - c0.g) * w2_dy;
-    float db_dy = (c1.b - c0.b) * w1_dy + (c2.b - c0.b) * w2_dy;
+#ifdef CSR_ENABLE_STATS
+  csr_stats *stats; /* counters of the worker rasterizing the rectangle */
+#endif
 
-    float r_start = c0.r + (c1.r - c0.r) * w1_start + (c2.r - c0.r) * w2_start;
-    float g_start = c0.g + (c1.g - c0.g) * w1_start + (c2.g - c0.g) * w2_start;
-    float b_start = c0.b + (c1.b - c0.b) * w1_start + (c2.b - c0.b) * w2_start;
+} csr_raster_rect;
 
-    int x, y;
+/* Parameters of a voxel ray cast shared by the row jobs */
+typedef struct csr_raycast
+{
+  unsigned char *voxels;
+  int grid[3];
+  csr_color colors[3];   /* colors of the faces perpendicular to the x, y and z axis */
+  float matrix[16];      /* projection view model matrix                            */
+  double inverse[16];    /* its inverse, maps NDC to model space                    */
 
-    for (y = min_y; y <= max_y; ++y)
-    {
-      float w0 = w0_start;
-      float w1 = w1_start;
-      float w2 = w2_start;
+} csr_raycast;
 
-      float current_r = r_start;
-      float current_g = g_start;
-      float current_b = b_start;
+/* A draw recorded into a command buffer, the arguments of csr_render */
+typedef struct csr_draw_command
+{
+  csr_render_mode render_mode;
+  csr_culling_mode culling_mode;
+  int stride;
+  float *vertices;
+  unsigned long num_vertices;
+  int *indices;
+  unsigned long num_indices;
+  float matrix[16]; /* projection view model matrix                              */
+  float bounds[6];  /* model space bounding box of the vertices                    */
+  float depth;      /* clip z of the bounding box center, the sort key of the draw */
 
-      int index_row_start = y * context->width + min_x;
+} csr_draw_command;
 
-      for (x = min_x; x <= max_x; ++x)
-      {
-        if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f)
-        {
-          /* Interpolate Z-depth using w values */
-          float z = p0[2] * w0 + p1[2] * w1 + p2[2] * w2;
+/* Draws recorded in caller provided memory and executed (sorted) by csr_execute */
+typedef struct csr_command_buffer
+{
+  csr_draw_command *commands;
+  unsigned long *order; /* execution order computed by csr_execute */
+  unsigned long count;
+  unsigned long capacity;
 
-          int index = index_row_start + (x - min_x);
+} csr_command_buffer;
 
-          /* Depth testing: only draw if the new pixel is closer than the existing one */
-          if (z < context->zbuffer[index])
-          {
-            csr_color pixel_color;
-            pixel_color.r = (unsigned char)current_r;
-            pixel_color.g = (unsigned char)current_g;
-            pixel_color.b = (unsigned char)current_b;
+/* Meshlets are clusters of up to CSR_MESHLET_TRIANGLES triangles built by csr_meshlets_build. Each has its own
+ * vertex list (at most 3 vertices per triangle, so one transform batch) and local triangle indices.
+ */
+#ifndef CSR_MESHLET_TRIANGLES
+#define CSR_MESHLET_TRIANGLES 64
+#endif
 
-            context->framebuffer[index] = pixel_color;
-            context->zbuffer[index] = z;
-          }
-        }
+#define CSR_MESHLET_VERTICES (CSR_MESHLET_TRIANGLES * 3)
 
-        /* Increment barycentric coordinates and colors with pre-calculated deltas */
-        w0 += w0_dx;
-        w1 += w1_dx;
-        w2 += w2_dx;
-        current_r += dr_dx;
-        current_g += dg_dx;
-        current_b += db_dx;
-      }
+/* Local vertex indices are stored as unsigned char, so CSR_MESHLET_TRIANGLES may be at most 85 (compile error otherwise) */
+typedef char csr_meshlet_vertices_check[(CSR_MESHLET_VERTICES <= 256) ? 1 : -1];
 
-      /* Reset w values and colors for the start of the next row */
-      w0_start += w0_dy;
-      w1_start += w1_dy;
-      w2_start += w2_dy;
-      r_start += dr_dy;
-      g_start += dg_dy;
-      b_start += db_dy;
-    }
-  }
-}
+/* Widens the normal cones against rounding, so triangles nearly edge on to the camera are never culled by the cone */
+#ifndef CSR_MESHLET_CONE_TOLERANCE
+#define CSR_MESHLET_CONE_TOLERANCE (1.0f / 1024.0f)
+#endif
 
-CSR_API CSR_INLINE void csr_render(csr_context *context, csr_render_mode render_mode, csr_culling_mode culling_mode, int stride, float *vertices, unsigned long num_vertices, int *indices, unsigned long num_indices, float projection_view_model_matrix[16])
+typedef struct csr_meshlet
 {
-  unsigned long i;
+  unsigned long vertex_offset;   /* first entry in the meshlet vertices (mesh vertex indices)       */
+  unsigned long triangle_offset; /* first entry in the meshlet triangles (3 local indices each)     */
+  int vertex_count;
+  int triangle_count;
+  float center[3];  /* model space bounding sphere                                                  */
+  float radius;
+  float cone_axis[3]; /* average direction of the triangle normals (cross product of the edges)       */
+  float cone_cutoff;  /* sine of the max. angle between a normal and the axis, > 1 if it can not cull */
 
-  (void)num_vertices;
+} csr_meshlet;
 
-  for (i = 0; i < num_indices; i += 3)
-  {
-    /* Get vertex indices for the current triangle */
-    int i0 = indices[i];
-    int i1 = indices[i + 1];
-    int i2 = indices[i + 2];
+/* Weight of the planes that keep open mesh borders in place during simplification, relative to the surface */
+#ifndef CSR_SIMPLIFY_BORDER_WEIGHT
+#define CSR_SIMPLIFY_BORDER_WEIGHT 10.0f
+#endif
+
+/* Screen area in pixels per triangle that csr_render_lod aims for when it picks a level of detail */
+#ifndef CSR_LOD_PIXELS_PER_TRIANGLE
+#define CSR_LOD_PIXELS_PER_TRIANGLE 8.0f
+#endif
+
+/* A possible edge collapse of the simplifier: vertex from moves onto vertex to */
+typedef struct csr_collapse
+{
+  int from;
+  int to;
+  float cost; /* quadric error of both vertices at the position of to */
 
-    /* Get the vertex data from the main vertex array using the indices, and convert to homogeneous coordinates */
-    float pos0[4];
-    float pos1[4];
-    float pos2[4];
+} csr_collapse;
 
-    /* 1. Vertex Processing (Model, View, Projection) */
-    float v0_transformed[4];
-    float v1_transformed[4];
-    float v2_transformed[4];
+/* A level of detail built by csr_lods_build, a range of the LOD indices. Level 0 is the original mesh. */
+typedef struct csr_lod
+{
+  unsigned long index_offset;
+  unsigned long index_count;
 
-    float v0_ndc[4];
-    float v1_ndc[4];
-    float v2_ndc[4];
+} csr_lod;
 
-    float v0_screen[3];
-    float v1_screen[3];
-    float v2_screen[3];
+/* #############################################################################
+ * # THREADING
+ * #############################################################################
+ */
+/* Define CSR_USE_PTHREADS before including this file to rasterize disjoint tiles on a
+ * pool of worker threads (link with -pthread). Without it no system header is included
+ * and the library stays nostdlib.
+ */
+struct csr_context;
 
-    csr_pos_init(pos0, vertices[i0 * stride + 0], vertices[i0 * stride + 1], vertices[i0 * stride + 2], 1.0f);
-    csr_pos_init(pos1, vertices[i1 * stride + 0], vertices[i1 * stride + 1], vertices[i1 * stride + 2], 1.0f);
-    csr_pos_init(pos2, vertices[i2 * stride + 0], vertices[i2 * stride + 1], vertices[i2 * stride + 2], 1.0f);
+/* A job is called once for every item in [0, items). worker is 0 for the calling thread and 1..n for the pool threads. */
+typedef void (*csr_job_function)(struct csr_context *context, int item, int worker);
 
-    csr_m4x4_mul_v4(v0_transformed, projection_view_model_matrix, pos0);
-    csr_m4x4_mul_v4(v1_transformed, projection_view_model_matrix, pos1);
-    csr_m4x4_mul_v4(v2_transformed, projection_view_model_matrix, pos2);
+#ifdef CSR_USE_PTHREADS
+#include <pthread.h>
 
-    /* Check if the triangle is behind the camera (clipping) */
-    if (v0_transformed[3] <= 0.0f || v1_transformed[3] <= 0.0f || v2_transformed[3] <= 0.0f)
-    {
-      continue;
-    }
+#ifndef CSR_THREADS_MAX
+#define CSR_THREADS_MAX 64
+#endif
 
-    /* 2. Perspective Divide (Clip Space to NDC) */
-    csr_v4_divf(v0_ndc, v0_transformed, v0_transformed[3]);
-    csr_v4_divf(v1_ndc, v1_transformed, v1_transformed[3]);
-    csr_v4_divf(v2_ndc, v2_transformed, v2_transformed[3]);
+typedef struct csr_thread_worker
+{
+  struct csr_thread_pool *pool;
+  int index;
 
-    /* 3. Viewport Transform (NDC to Screen Space) */
-    csr_ndc_to_screen(context, v0_screen, v0_ndc);
-    csr_ndc_to_screen(context, v1_screen, v1_ndc);
-    csr_ndc_to_screen(context, v2_screen, v2_ndc);
+} csr_thread_worker;
 
-    /* 4. Culling based on winding order */
-    if (culling_mode != CSR_CULLING_DISABLED)
-    {
-      float ax = v1_screen[0] - v0_screen[0];
-      float ay = v1_screen[1] - v0_screen[1];
-      float bx = v2_screen[0] - v0_screen[0];
-      float by = v2_screen[1] - v0_screen[1];
-      float face = ax * by - ay * bx;
+typedef struct csr_thread_pool
+{
+  pthread_t threads[CSR_THREADS_MAX];
+  csr_thread_worker workers[CSR_THREADS_MAX];
+  int threads_count; /* number of started worker threads (the calling thread not included) */
+  int shutdown;
 
-      int is_ccw_face = (face >= 0.0f);
-      int is_cw_face = (face <= 0.0f);
+  pthread_mutex_t mutex;
+  pthread_cond_t job_start;
+  pthread_cond_t job_done;
 
-      int should_cull = 0;
+  struct csr_context *context;
+  csr_job_function job;
+  int job_items;                /* number of items of the current job      */
+  int job_next;                 /* next item to be picked up by a thread   */
+  int job_pending;              /* number of items not finished yet        */
+  unsigned long job_generation; /* incremented for every dispatched job    */
 
-      should_cull |= (culling_mode == CSR_CULLING_CCW_BACKFACE) & is_cw_face;
-      should_cull |= (culling_mode == CSR_CULLING_CCW_FRONTFACE) & is_ccw_face;
-      should_cull |= (culling_mode == CSR_CULLING_CW_BACKFACE) & is_ccw_face;
-      should_cull |= (culling_mode == CSR_CULLING_CW_FRONTFACE) & is_cw_face;
+} csr_thread_pool;
 
-      if (should_cull)
-      {
-        continue;
-      }
-    }
+#define CSR_WORKERS_MAX (CSR_THREADS_MAX + 1)
+#else
+#define CSR_WORKERS_MAX 1
+#endif
 
-    /* 5. Rasterization & Depth Testing */
-    if (render_mode == CSR_RENDER_SOLID)
-    {
-      csr_color color0 = stride == 3 ? csr_init_color(255, 50, 50) : csr_init_color((unsigned char)vertices[i0 * stride + 3], (unsigned char)vertices[i0 * stride + 4], (unsigned char)vertices[i0 * stride + 5]);
-      csr_color color1 = stride == 3 ? csr_init_color(50, 255, 50) : csr_init_color((unsigned char)vertices[i1 * stride + 3], (unsigned char)vertices[i1 * stride + 4], (unsigned char)vertices[i1 * stride + 5]);
-      csr_color color2 = stride == 3 ? csr_init_color(50, 50, 255) : csr_init_color((unsigned char)vertices[i2 * stride + 3], (unsigned char)vertices[i2 * stride + 4], (unsigned char)vertices[i2 * stride + 5]);
+/* #############################################################################
+ * # KERNELS
+ * #############################################################################
+ */
+/* The hot loops exist in scalar, SSE2 and AVX2 variants. csr_init_model fills the kernel
+ * table with the widest variant the running CPU supports (CPUID), so a single build
+ * uses AVX2 where available and falls back to SSE2 or scalar code elsewhere.
+ */
+typedef enum csr_simd_level
+{
+  CSR_SIMD_SCALAR = 0,
+  CSR_SIMD_SSE2 = 1,
+  CSR_SIMD_AVX2 = 2
 
-      csr_draw_triangle(context, v0_screen, v1_screen, v2_screen, color0, color1, color2);
-    }
-    else
-    {
-      csr_color color0 = stride == 3 ? csr_init_color(255, 50, 50) : csr_init_color((unsigned char)vertices[i0 * stride + 3], (unsigned char)vertices[i0 * stride + 4], (unsigned char)vertices[i0 * stride + 5]);
+} csr_simd_level;
 
-      csr_draw_line(context, v0_screen, v1_screen, color0);
-      csr_draw_line(context, v1_screen, v2_screen, color0);
-      csr_draw_line(context, v2_screen, v0_screen, color0);
-    }
-  }
+/* Number of indices transformed per call of the transform kernel (multiple of 3) */
+#ifndef CSR_VERTEX_BATCH_SIZE
+#define CSR_VERTEX_BATCH_SIZE 192
+#endif
+
+/* Max. number of vertices of a mesh kept in the vertex cache (screen position and clip w, SoA) */
+#ifndef CSR_VERTICES_MAX
+#define CSR_VERTICES_MAX 65536
+#endif
+
+/* Raster and line kernels return the number of pixels that passed the depth test while an occlusion query is active, otherwise 0 */
+typedef void (*csr_clear_kernel)(struct csr_context *context, int index, int count, csr_color clear_color, int stream);
+typedef void (*csr_transform_kernel)(float m[16], float *positions[3], float *clip[4], int count);
+typedef unsigned long (*csr_raster_kernel)(struct csr_context *context, csr_triangle *tri, csr_raster_rect *rect);
+typedef unsigned long (*csr_line_kernel)(struct csr_context *context, float p0[3], float p1[3], csr_color color);
+
+typedef struct csr_kernels
+{
+  csr_simd_level level;           /* SIMD level of the selected kernels                     */
+  csr_clear_kernel clear;         /* fills pixels with the clear color and resets their depth */
+  csr_transform_kernel transform; /* object space positions (SoA) to clip space (SoA)      */
+  csr_raster_kernel raster;       /* rasterizes a triangle inside a rectangle              */
+  csr_line_kernel line;           /* depth tested line                                     */
+
+} csr_kernels;
+
+typedef struct csr_context
+{
+
+  int width;              /* render area width in pixels            */
+  int height;             /* render area height in pixels           */
+  csr_color *framebuffer; /* memory pointer for framebuffer         */
+  float *zbuffer;         /* memory pointer for zbuffer             */
+  csr_kernels kernels;    /* kernels selected for the running CPU   */
+  csr_render_mode mode;   /* mode of the triangles being rasterized */
+  int mesh_inside;        /* the mesh being set up is inside the screen */
+
+  /* Tile binning state. Only available if csr_init_model received at least csr_memory_size bytes. */
+  int tiles_x;                   /* number of tiles in x direction                 */
+  int tiles_y;                   /* number of tiles in y direction                 */
+  csr_triangle *triangles;       /* set up triangles waiting to be rasterized      */
+  unsigned long triangles_count; /* number of pending triangles                    */
+  unsigned long bin_count;       /* number of pending (tile, triangle) references  */
+  int *bin_offsets;              /* start of each tiles triangle list (tiles + 1)  */
+  int *bin_cursor;               /* per tile write position while binning         */
+  int *bin_entries;              /* triangle indices sorted by tile                */
+
+  /* Hierarchical depth. Upper bounds of the zbuffer values, so code writing the zbuffer directly
+   * may only lower its values. Only available together with tile binning.
+   */
+  float *hiz;                     /* max. depth per block, the blocks of a tile are stored together */
+  float *hiz_tiles;               /* max. depth per tile                                            */
+  unsigned char *hiz_dirty;       /* blocks written since their max. depth was last computed        */
+  unsigned char *hiz_tiles_dirty; /* per tile the first and last block changed since the last update  */
+
+  /* Fast clear (see csr_render_clear_screen_fast). Tiles with a set flag still hold the old colors and depths while
+   * clear_pending is set. Only available together with tile binning.
+   */
+  unsigned char *clear_tiles; /* per tile the fill with the clear color and depth is pending */
+  int clear_pending;          /* tiles may be flagged since the last fast clear           */
+  csr_color clear_color;      /* color of the pending fast clear                          */
+
+  /* Screen x, y, z and clip w of the vertices of the mesh being rendered, CSR_VERTICES_MAX floats each.
+   * Only available together with tile binning.
+   */
+  float *vertex_cache;
+
+  csr_raycast *raycast; /* parameters of the running voxel ray cast */
+
+  /* Visibility buffer: ids of the nearest triangles written instead of colors while active (see
+   * csr_execute_visibility). Only available together with tile binning.
+   */
+  unsigned int *visibility;
+  int visibility_active;
+  unsigned int visibility_draw;            /* draw id in the upper bits of the ids of the draw being set up */
+  unsigned int visibility_id;              /* id of the triangle being set up                               */
+  struct csr_command_buffer *visibility_draws; /* draws of the visibility buffer being resolved            */
+
+#ifdef CSR_ENABLE_STATS
+  csr_stats stats[CSR_WORKERS_MAX]; /* pipeline counters per worker thread, the setup stage counts in 0 */
+#endif
+
+#ifdef CSR_ENABLE_TIMINGS
+  csr_timer_function timer;                    /* cycle counter, the stages are not timed while 0 */
+  int timer_active;                            /* a render call is timing its stages              */
+  unsigned long timer_last;                    /* timer value at the end of the last stage        */
+  unsigned long stage_cycles[CSR_STAGE_COUNT]; /* cycles per csr_stage since csr_timings_reset    */
+#endif
+
+  /* Debug output while not 0 (see csr_debug_begin) */
+  unsigned int *overdraw;     /* per pixel number of depth tested triangle, line and ray pixels */
+  unsigned long *tile_cycles; /* per tile cycles spent rasterizing, needs CSR_ENABLE_TIMINGS   */
+
+  /* Occlusion query. Pixels passing the depth test are counted per worker thread while active. */
+  int query_active;
+  unsigned long query_samples[CSR_WORKERS_MAX];
+
+#ifdef CSR_USE_PTHREADS
+  csr_thread_pool threads; /* worker threads started by csr_threads_init */
+#endif
+
+} csr_context;
+
+CSR_API CSR_INLINE unsigned long csr_memory_align(unsigned long size)
+{
+  return (size + 15UL) & ~15UL;
+}
+
+/* Returns the memory size needed for the framebuffer and zbuffer alone. */
+CSR_API CSR_INLINE unsigned long csr_memory_size_buffers(int width, int height)
+{
+  unsigned long area = (unsigned long)(width * height);
+
+  return (unsigned long)(area * (unsigned long)sizeof(csr_color) + /* framebuffer size */
+                         area * (unsigned long)sizeof(float)       /* zbuffer size     */
+  );
+}
+
+/* Returns the recommended memory size including the scratch memory for tile binning. */
+CSR_API CSR_INLINE unsigned long csr_memory_size(int width, int height)
+{
+  unsigned long tiles = (unsigned long)(((width + CSR_TILE_SIZE - 1) / CSR_TILE_SIZE) * ((height + CSR_TILE_SIZE - 1) / CSR_TILE_SIZE));
+  unsigned long blocks = tiles * CSR_BLOCKS_PER_TILE * CSR_BLOCKS_PER_TILE;
+
+  return csr_memory_align(csr_memory_size_buffers(width, height)) +
+         csr_memory_align(CSR_TRIANGLE_BATCH_SIZE * (unsigned long)sizeof(csr_triangle)) + /* triangle batch */
+         csr_memory_align((tiles + 1) * (unsigned long)sizeof(int)) +                      /* bin offsets    */
+         csr_memory_align(tiles * (unsigned long)sizeof(int)) +                            /* bin cursors    */
+         csr_memory_align(CSR_BIN_ENTRIES_MAX * (unsigned long)sizeof(int)) +              /* bin entries    */
+         csr_memory_align(blocks * (unsigned long)sizeof(float)) +                         /* block depths   */
+         csr_memory_align(tiles * (unsigned long)sizeof(float)) +                          /* tile depths    */
+         csr_memory_align(blocks) +                                                        /* dirty blocks   */
+         csr_memory_align(tiles * 2) +                                                     /* dirty tiles    */
+         csr_memory_align(tiles) +                                                         /* clear flags    */
+         csr_memory_align(CSR_VERTICES_MAX * 4 * (unsigned long)sizeof(float)) +           /* vertex cache   */
+         csr_memory_align((unsigned long)(width * height) * (unsigned long)sizeof(int));   /* visibility     */
+}
+
+/* Returns the index of the block containing pixel (x, y) in the hierarchical depth buffers. */
+CSR_API CSR_INLINE int csr_hiz_block(csr_context *context, int x, int y)
+{
+  int tile = (y / CSR_TILE_SIZE) * context->tiles_x + x / CSR_TILE_SIZE;
+
+  return tile * CSR_BLOCKS_PER_TILE * CSR_BLOCKS_PER_TILE +
+         ((y % CSR_TILE_SIZE) / CSR_BLOCK_SIZE) * CSR_BLOCKS_PER_TILE + (x % CSR_TILE_SIZE) / CSR_BLOCK_SIZE;
+}
+
+/* Returns the max. of 8 consecutive values (a block row or a tile row of blocks), reduced pairwise to keep the dependency chains short. */
+CSR_API CSR_INLINE float csr_max8f(float *v)
+{
+  return csr_maxf(csr_maxf(csr_maxf(v[0], v[1]), csr_maxf(v[2], v[3])), csr_maxf(csr_maxf(v[4], v[5]), csr_maxf(v[6], v[7])));
+}
+
+/* Extends the range of blocks (indices inside of the tile) whose max. depth changed since the tile was updated. */
+CSR_API CSR_INLINE void csr_hiz_touch(csr_context *context, int tile, int first, int last)
+{
+  unsigned char *range = &context->hiz_tiles_dirty[tile * 2];
+
+  if (first < range[0])
+  {
+    range[0] = (unsigned char)first;
+  }
+
+  if (last > range[1])
+  {
+    range[1] = (unsigned char)last;
+  }
+}
+
+/* Returns 0 if a triangle with the nearest depth z_near inside of the rectangle (in a single tile)
+ * is hidden in all blocks the rectangle touches. Otherwise the blocks are marked as written if
+ * depth_write is set. Marks left on hidden blocks only cause an unnecessary update later.
+ */
+CSR_API CSR_INLINE int csr_hiz_test_rect(csr_context *context, int tile, int min_x, int min_y, int max_x, int max_y, float z_near, int depth_write)
+{
+  float *hiz = &context->hiz[tile * CSR_BLOCKS_PER_TILE * CSR_BLOCKS_PER_TILE];
+  unsigned char *dirty = &context->hiz_dirty[tile * CSR_BLOCKS_PER_TILE * CSR_BLOCKS_PER_TILE];
+  int first_x = (min_x % CSR_TILE_SIZE) / CSR_BLOCK_SIZE;
+  int last_x = (max_x % CSR_TILE_SIZE) / CSR_BLOCK_SIZE;
+  int first = ((min_y % CSR_TILE_SIZE) / CSR_BLOCK_SIZE) * CSR_BLOCKS_PER_TILE + first_x;
+  int last = ((max_y % CSR_TILE_SIZE) / CSR_BLOCK_SIZE) * CSR_BLOCKS_PER_TILE + last_x;
+  float depth = -CSR_DEPTH_UNKNOWN;
+  int row, block;
+
+  for (row = first; row <= last; row += CSR_BLOCKS_PER_TILE)
+  {
+    for (block = row; block <= row + last_x - first_x; ++block)
+    {
+      depth = csr_maxf(depth, hiz[block]);
+      dirty[block] = (unsigned char)(dirty[block] | depth_write);
+    }
+  }
+
+  if (z_near >= depth)
+  {
+    return 0;
+  }
+
+  if (depth_write)
+  {
+    csr_hiz_touch(context, tile, first, last);
+  }
+
+  return 1;
+}
+
+/* Sets the max. depth of all blocks and tiles, e.g. to the clear depth. */
+CSR_API CSR_INLINE void csr_hiz_reset(csr_context *context, float depth)
+{
+  int tiles = context->tiles_x * context->tiles_y;
+  int i, x, y;
+
+  if (!context->hiz)
+  {
+    return;
+  }
+
+  for (i = 0; i < tiles * CSR_BLOCKS_PER_TILE * CSR_BLOCKS_PER_TILE; ++i)
+  {
+    context->hiz[i] = depth;
+    context->hiz_dirty[i] = 0;
+  }
+
+  for (i = 0; i < tiles; ++i)
+  {
+    context->hiz_tiles[i] = depth;
+    context->hiz_tiles_dirty[i * 2 + 0] = CSR_BLOCKS_PER_TILE * CSR_BLOCKS_PER_TILE;
+    context->hiz_tiles_dirty[i * 2 + 1] = 0;
+  }
+
+  /* Blocks outside of the screen get the lowest depth so that they never raise the max. depth of their tile */
+  for (y = 0; y < context->tiles_y * CSR_TILE_SIZE; y += CSR_BLOCK_SIZE)
+  {
+    for (x = (y < context->height) ? (context->width + CSR_BLOCK_SIZE - 1) & ~(CSR_BLOCK_SIZE - 1) : 0; x < context->tiles_x * CSR_TILE_SIZE; x += CSR_BLOCK_SIZE)
+    {
+      context->hiz[csr_hiz_block(context, x, y)] = -CSR_DEPTH_UNKNOWN;
+    }
+  }
+}
+
+CSR_API CSR_INLINE csr_simd_level csr_set_simd_level(csr_context *context, csr_simd_level level);
+
+#ifdef CSR_ENABLE_STATS
+/* Clears the pipeline counters of all workers, e.g. at the start of a frame. */
+CSR_API CSR_INLINE void csr_stats_reset(csr_context *context)
+{
+  unsigned long *counters = (unsigned long *)context->stats;
+  unsigned long i;
+
+  for (i = 0; i < (unsigned long)sizeof(context->stats) / (unsigned long)sizeof(unsigned long); ++i)
+  {
+    counters[i] = 0;
+  }
+}
+
+/* Sums the pipeline counters of all workers since the last csr_stats_reset into stats. */
+CSR_API CSR_INLINE void csr_stats_collect(csr_context *context, csr_stats *stats)
+{
+  unsigned long *sum = (unsigned long *)stats;
+  unsigned long count = (unsigned long)sizeof(csr_stats) / (unsigned long)sizeof(unsigned long);
+  unsigned long i;
+  int worker;
+
+  for (i = 0; i < count; ++i)
+  {
+    sum[i] = 0;
+
+    for (worker = 0; worker < CSR_WORKERS_MAX; ++worker)
+    {
+      sum[i] += ((unsigned long *)&context->stats[worker])[i];
+    }
+  }
+}
+#endif
+
+#ifdef CSR_ENABLE_TIMINGS
+/* Clears the cycles spent per stage, e.g. at the start of a frame. */
+CSR_API CSR_INLINE void csr_timings_reset(csr_context *context)
+{
+  int stage;
+
+  for (stage = 0; stage < CSR_STAGE_COUNT; ++stage)
+  {
+    context->stage_cycles[stage] = 0;
+  }
+}
+
+/* Starts timing the stages if a timer is set and no enclosing call is timing them already. Returns 1 if this
+ * call has to stop the timer again.
+ */
+CSR_API CSR_INLINE int csr_timer_start(csr_context *context)
+{
+  if (!context->timer || context->timer_active)
+  {
+    return 0;
+  }
+
+  context->timer_active = 1;
+  context->timer_last = context->timer();
+
+  return 1;
+}
+
+/* Adds the cycles since the last lap to the stage that just ended. */
+CSR_API CSR_INLINE void csr_timer_lap(csr_context *context, csr_stage stage)
+{
+  if (context->timer_active)
+  {
+    unsigned long now = context->timer();
+
+    context->stage_cycles[stage] += now - context->timer_last;
+    context->timer_last = now;
+  }
+}
+
+CSR_API CSR_INLINE void csr_timer_stop(csr_context *context, int started)
+{
+  if (started)
+  {
+    context->timer_active = 0;
+  }
+}
+#endif
+
+/* Initializes the context. The memory must be at least csr_memory_size_buffers bytes large.
+ * If less than csr_memory_size bytes are provided tile binning is disabled and triangles
+ * are rasterized immediately. With CSR_USE_PTHREADS the context starts without worker threads:
+ * call csr_threads_shutdown before initializing a context again whose threads are running,
+ * otherwise they are never joined.
+ */
+CSR_API CSR_INLINE int csr_init_model(csr_context *context, void *memory, unsigned long memory_size, int width, int height)
+{
+  unsigned long memory_framebuffer_size = (unsigned long)(width * height) * (unsigned long)sizeof(csr_color);
+  int i;
+
+  if (memory_size < csr_memory_size_buffers(width, height))
+  {
+    return 0;
+  }
+
+  context->width = width;
+  context->height = height;
+  context->framebuffer = (csr_color *)memory;
+  context->zbuffer = (float *)((char *)memory + memory_framebuffer_size);
+  context->mode = CSR_RENDER_SOLID;
+  context->mesh_inside = 0;
+  context->query_active = 0;
+
+  for (i = 0; i < CSR_WORKERS_MAX; ++i)
+  {
+    context->query_samples[i] = 0;
+  }
+
+  context->tiles_x = (width + CSR_TILE_SIZE - 1) / CSR_TILE_SIZE;
+  context->tiles_y = (height + CSR_TILE_SIZE - 1) / CSR_TILE_SIZE;
+  context->triangles = 0;
+  context->triangles_count = 0;
+  context->bin_count = 0;
+  context->bin_offsets = 0;
+  context->bin_cursor = 0;
+  context->bin_entries = 0;
+  context->hiz = 0;
+  context->hiz_tiles = 0;
+  context->hiz_dirty = 0;
+  context->hiz_tiles_dirty = 0;
+  context->clear_tiles = 0;
+  context->clear_pending = 0;
+  context->clear_color.r = 0;
+  context->clear_color.g = 0;
+  context->clear_color.b = 0;
+  context->vertex_cache = 0;
+  context->raycast = 0;
+  context->visibility = 0;
+  context->visibility_active = 0;
+  context->visibility_draw = 0;
+  context->visibility_id = 0;
+  context->visibility_draws = 0;
+  context->overdraw = 0;
+  context->tile_cycles = 0;
+
+#ifdef CSR_USE_PTHREADS
+  context->threads.threads_count = 0;
+#endif
+
+#ifdef CSR_ENABLE_STATS
+  csr_stats_reset(context);
+#endif
+
+#ifdef CSR_ENABLE_TIMINGS
+  context->timer = 0;
+  context->timer_active = 0;
+  context->timer_last = 0;
+  csr_timings_reset(context);
+#endif
+
+  csr_set_simd_level(context, CSR_SIMD_AVX2);
+
+  if (memory_size >= csr_memory_size(width, height))
+  {
+    unsigned long tiles = (unsigned long)(context->tiles_x * context->tiles_y);
+    unsigned long blocks = tiles * CSR_BLOCKS_PER_TILE * CSR_BLOCKS_PER_TILE;
+    char *scratch = (char *)memory + csr_memory_align(csr_memory_size_buffers(width, height));
+
+    context->triangles = (csr_triangle *)scratch;
+    scratch += csr_memory_align(CSR_TRIANGLE_BATCH_SIZE * (unsigned long)sizeof(csr_triangle));
+    context->bin_offsets = (int *)scratch;
+    scratch += csr_memory_align((tiles + 1) * (unsigned long)sizeof(int));
+    context->bin_cursor = (int *)scratch;
+    scratch += csr_memory_align(tiles * (unsigned long)sizeof(int));
+    context->bin_entries = (int *)scratch;
+    scratch += csr_memory_align(CSR_BIN_ENTRIES_MAX * (unsigned long)sizeof(int));
+    context->hiz = (float *)scratch;
+    scratch += csr_memory_align(blocks * (unsigned long)sizeof(float));
+    context->hiz_tiles = (float *)scratch;
+    scratch += csr_memory_align(tiles * (unsigned long)sizeof(float));
+    context->hiz_dirty = (unsigned char *)scratch;
+    scratch += csr_memory_align(blocks);
+    context->hiz_tiles_dirty = (unsigned char *)scratch;
+    scratch += csr_memory_align(tiles * 2);
+    context->clear_tiles = (unsigned char *)scratch;
+    scratch += csr_memory_align(tiles);
+    context->vertex_cache = (float *)scratch;
+    scratch += csr_memory_align(CSR_VERTICES_MAX * 4 * (unsigned long)sizeof(float));
+    context->visibility = (unsigned int *)scratch;
+
+    /* The zbuffer content is not known until the first clear */
+    csr_hiz_reset(context, CSR_DEPTH_UNKNOWN);
+  }
+
+  return 1;
+}
+
+#ifdef CSR_USE_PTHREADS
+CSR_API CSR_INLINE void *csr_thread_main(void *arg)
+{
+  csr_thread_worker *worker = (csr_thread_worker *)arg;
+  csr_thread_pool *pool = worker->pool;
+  unsigned long generation = 0;
+
+  pthread_mutex_lock(&pool->mutex);
+
+  for (;;)
+  {
+    while (!pool->shutdown && pool->job_generation == generation)
+    {
+      pthread_cond_wait(&pool->job_start, &pool->mutex);
+    }
+
+    if (pool->shutdown)
+    {
+      break;
+    }
+
+    generation = pool->job_generation;
+
+    while (pool->job_next < pool->job_items)
+    {
+      int item = pool->job_next++;
+
+      pthread_mutex_unlock(&pool->mutex);
+      pool->job(pool->context, item, worker->index);
+      pthread_mutex_lock(&pool->mutex);
+
+      if (--pool->job_pending == 0)
+      {
+        pthread_cond_signal(&pool->job_done);
+      }
+    }
+  }
+
+  pthread_mutex_unlock(&pool->mutex);
+
+  return 0;
+}
+
+/* Stops and joins all worker threads started by csr_threads_init. */
+CSR_API CSR_INLINE void csr_threads_shutdown(csr_context *context)
+{
+  csr_thread_pool *pool = &context->threads;
+  int i;
+
+  if (pool->threads_count == 0)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->job_start);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (i = 0; i < pool->threads_count; ++i)
+  {
+    pthread_join(pool->threads[i], 0);
+  }
+
+  pthread_cond_destroy(&pool->job_done);
+  pthread_cond_destroy(&pool->job_start);
+  pthread_mutex_destroy(&pool->mutex);
+
+  pool->threads_count = 0;
+}
+
+/* Starts the worker pool after csr_init_model. thread_count is the total number of
+ * rendering threads including the calling thread. Returns 0 if the pool could not be started.
+ */
+CSR_API CSR_INLINE int csr_threads_init(csr_context *context, int thread_count)
+{
+  csr_thread_pool *pool = &context->threads;
+  int i;
+
+  if (thread_count < 1 || thread_count > CSR_THREADS_MAX || pool->threads_count != 0)
+  {
+    return 0;
+  }
+
+  if (thread_count == 1)
+  {
+    return 1;
+  }
+
+  pool->shutdown = 0;
+  pool->context = context;
+  pool->job = 0;
+  pool->job_items = 0;
+  pool->job_next = 0;
+  pool->job_pending = 0;
+  pool->job_generation = 0;
+
+  if (pthread_mutex_init(&pool->mutex, 0) != 0)
+  {
+    return 0;
+  }
+
+  pthread_cond_init(&pool->job_start, 0);
+  pthread_cond_init(&pool->job_done, 0);
+
+  for (i = 0; i < thread_count - 1; ++i)
+  {
+    pool->workers[i].pool = pool;
+    pool->workers[i].index = i + 1;
+
+    if (pthread_create(&pool->threads[i], 0, csr_thread_main, &pool->workers[i]) != 0)
+    {
+      break;
+    }
+
+    pool->threads_count++;
+  }
+
+  if (pool->threads_count != thread_count - 1)
+  {
+    csr_threads_shutdown(context);
+    return 0;
+  }
+
+  return 1;
+}
+#endif
+
+/* Calls job for every item in [0, items). With CSR_USE_PTHREADS the items are shared
+ * between the calling thread and the worker pool, otherwise they run in order.
+ */
+CSR_API CSR_INLINE void csr_parallel_for(csr_context *context, int items, csr_job_function job)
+{
+  int i;
+
+#ifdef CSR_USE_PTHREADS
+  csr_thread_pool *pool = &context->threads;
+
+  if (pool->threads_count > 0 && items > 1)
+  {
+    pthread_mutex_lock(&pool->mutex);
+
+    pool->job = job;
+    pool->job_items = items;
+    pool->job_next = 0;
+    pool->job_pending = items;
+    pool->job_generation++;
+
+    pthread_cond_broadcast(&pool->job_start);
+
+    /* The calling thread helps out until all items are picked up */
+    while (pool->job_next < pool->job_items)
+    {
+      int item = pool->job_next++;
+
+      pthread_mutex_unlock(&pool->mutex);
+      job(context, item, 0);
+      pthread_mutex_lock(&pool->mutex);
+
+      pool->job_pending--;
+    }
+
+    while (pool->job_pending > 0)
+    {
+      pthread_cond_wait(&pool->job_done, &pool->mutex);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    return;
+  }
+#endif
+
+  for (i = 0; i < items; ++i)
+  {
+    job(context, i, 0);
+  }
+}
+
+CSR_API CSR_INLINE csr_color csr_init_color(unsigned char r, unsigned char g, unsigned char b)
+{
+  csr_color result;
+  result.r = r;
+  result.g = g;
+  result.b = b;
+
+  return result;
+}
+
+/* Converts a point from normalized device coordinates(NDC) to screen space. */
+CSR_API CSR_INLINE void csr_ndc_to_screen(csr_context *context, float result[3], float ndc_pos[4])
+{
+  result[0] = (ndc_pos[0] + 1.0f) * 0.5f * (float)context->width;
+  result[1] = (1.0f - ndc_pos[1]) * 0.5f * (float)context->height;
+  result[2] = ndc_pos[2];
+}
+
+/* Fills count pixels from index on with the clear color and the depth 1.0. There are no streaming stores in
+ * scalar code, stream is ignored.
+ */
+CSR_API CSR_INLINE void csr_kernel_clear_scalar(csr_context *context, int index, int count, csr_color clear_color, int stream)
+{
+  csr_color *colors = &context->framebuffer[index];
+  float *depths = &context->zbuffer[index];
+
+  int i = 0;
+
+  (void)stream;
+
+  for (; i + 4 <= count; i += 4)
+  {
+    colors[i] = clear_color;
+    colors[i + 1] = clear_color;
+    colors[i + 2] = clear_color;
+    colors[i + 3] = clear_color;
+    depths[i] = 1.0f;
+    depths[i + 1] = 1.0f;
+    depths[i + 2] = 1.0f;
+    depths[i + 3] = 1.0f;
+  }
+
+  for (; i < count; ++i)
+  {
+    colors[i] = clear_color;
+    depths[i] = 1.0f;
+  }
+}
+
+#ifdef CSR_HAS_SSE2
+/* Clears 16 pixels (48 color bytes) per iteration with 16 byte stores. With stream set the stores are non-temporal
+ * once the colors and depths are 16 byte aligned, so clearing pixels that are not drawn to right away does not
+ * evict the caches.
+ */
+CSR_API CSR_INLINE void csr_kernel_clear_sse2(csr_context *context, int index, int count, csr_color clear_color, int stream)
+{
+  csr_color *pixels = &context->framebuffer[index];
+  unsigned char *colors = (unsigned char *)pixels;
+  float *depths = &context->zbuffer[index];
+  unsigned char pattern[48];
+  __m128i color0, color1, color2;
+  __m128 depth = _mm_set1_ps(1.0f);
+  int i;
+
+  for (i = 0; i < 16; ++i)
+  {
+    pattern[i * 3 + 0] = clear_color.r;
+    pattern[i * 3 + 1] = clear_color.g;
+    pattern[i * 3 + 2] = clear_color.b;
+  }
+
+  color0 = _mm_loadu_si128((__m128i *)&pattern[0]);
+  color1 = _mm_loadu_si128((__m128i *)&pattern[16]);
+  color2 = _mm_loadu_si128((__m128i *)&pattern[32]);
+
+  i = 0;
+
+  if (stream)
+  {
+    /* A color is 3 bytes, so one of the first 16 pixels starts on a 16 byte boundary */
+    for (; i < count && ((size_t)&colors[i * 3] & 15) != 0; ++i)
+    {
+      pixels[i] = clear_color;
+    }
+
+    for (; i + 16 <= count; i += 16)
+    {
+      _mm_stream_si128((__m128i *)&colors[i * 3 + 0], color0);
+      _mm_stream_si128((__m128i *)&colors[i * 3 + 16], color1);
+      _mm_stream_si128((__m128i *)&colors[i * 3 + 32], color2);
+    }
+  }
+
+  for (; i + 16 <= count; i += 16)
+  {
+    _mm_storeu_si128((__m128i *)&colors[i * 3 + 0], color0);
+    _mm_storeu_si128((__m128i *)&colors[i * 3 + 16], color1);
+    _mm_storeu_si128((__m128i *)&colors[i * 3 + 32], color2);
+  }
+
+  for (; i < count; ++i)
+  {
+    pixels[i] = clear_color;
+  }
+
+  i = 0;
+
+  /* The zbuffer follows the framebuffer and is only 4 byte aligned if the pixel count is a multiple of 4 */
+  if (stream && ((size_t)depths & 3) == 0)
+  {
+    for (; i < count && ((size_t)&depths[i] & 15) != 0; ++i)
+    {
+      depths[i] = 1.0f;
+    }
+
+    for (; i + 16 <= count; i += 16)
+    {
+      _mm_stream_ps(&depths[i + 0], depth);
+      _mm_stream_ps(&depths[i + 4], depth);
+      _mm_stream_ps(&depths[i + 8], depth);
+      _mm_stream_ps(&depths[i + 12], depth);
+    }
+  }
+
+  for (; i + 16 <= count; i += 16)
+  {
+    _mm_storeu_ps(&depths[i + 0], depth);
+    _mm_storeu_ps(&depths[i + 4], depth);
+    _mm_storeu_ps(&depths[i + 8], depth);
+    _mm_storeu_ps(&depths[i + 12], depth);
+  }
+
+  for (; i < count; ++i)
+  {
+    depths[i] = 1.0f;
+  }
+
+  /* Streaming stores are weakly ordered, make them visible before the pixels are read again */
+  if (stream)
+  {
+    _mm_sfence();
+  }
+}
+#endif
+
+/* Fills the framebuffer with the clear color and the zbuffer with 1.0. */
+CSR_API CSR_INLINE void csr_render_clear_screen(csr_context *context, csr_color clear_color)
+{
+  context->kernels.clear(context, 0, context->width * context->height, clear_color, 1);
+  context->clear_pending = 0;
+  csr_hiz_reset(context, 1.0f);
+}
+
+/* Fast clear: only flags all tiles as cleared and keeps the clear color instead of writing every pixel. A tile is
+ * filled the first time it is drawn to, csr_render_resolve fills the tiles nothing was drawn to before the
+ * framebuffer or zbuffer is read. Without tile binning memory the screen is cleared right away.
+ */
+CSR_API CSR_INLINE void csr_render_clear_screen_fast(csr_context *context, csr_color clear_color)
+{
+  int i;
+
+  if (!context->clear_tiles)
+  {
+    csr_render_clear_screen(context, clear_color);
+    return;
+  }
+
+  for (i = 0; i < context->tiles_x * context->tiles_y; ++i)
+  {
+    context->clear_tiles[i] = 1;
+  }
+
+  context->clear_color = clear_color;
+  context->clear_pending = 1;
+  csr_hiz_reset(context, 1.0f);
+}
+
+/* Fills a tile whose fast clear is pending right before it is drawn to. */
+CSR_API CSR_INLINE void csr_clear_tile(csr_context *context, int tile)
+{
+  int min_x = (tile % context->tiles_x) * CSR_TILE_SIZE;
+  int min_y = (tile / context->tiles_x) * CSR_TILE_SIZE;
+  int count = csr_mini(min_x + CSR_TILE_SIZE, context->width) - min_x;
+  int end_y = csr_mini(min_y + CSR_TILE_SIZE, context->height);
+  int y;
+
+  for (y = min_y; y < end_y; ++y)
+  {
+    context->kernels.clear(context, y * context->width + min_x, count, context->clear_color, 0);
+  }
+
+  context->clear_tiles[tile] = 0;
+}
+
+/* Fills the tiles with a pending fast clear that overlap the (inclusive) screen rectangle. Used before pixels are
+ * written outside of the tile rasterization, e.g. by lines.
+ */
+CSR_API CSR_INLINE void csr_clear_rect(csr_context *context, int min_x, int min_y, int max_x, int max_y)
+{
+  int tile_x, tile_y;
+
+  if (!context->clear_pending)
+  {
+    return;
+  }
+
+  min_x = csr_maxi(min_x, 0);
+  min_y = csr_maxi(min_y, 0);
+  max_x = csr_mini(max_x, context->width - 1);
+  max_y = csr_mini(max_y, context->height - 1);
+
+  if (min_x > max_x || min_y > max_y)
+  {
+    return;
+  }
+
+  for (tile_y = min_y / CSR_TILE_SIZE; tile_y <= max_y / CSR_TILE_SIZE; ++tile_y)
+  {
+    for (tile_x = min_x / CSR_TILE_SIZE; tile_x <= max_x / CSR_TILE_SIZE; ++tile_x)
+    {
+      if (context->clear_tiles[tile_y * context->tiles_x + tile_x])
+      {
+        csr_clear_tile(context, tile_y * context->tiles_x + tile_x);
+      }
+    }
+  }
+}
+
+/* Fills all tiles whose fast clear is still pending, call it before reading the framebuffer or zbuffer. Runs of
+ * flagged tiles in a tile row are filled as one span per pixel row with streaming stores, they are not drawn to
+ * anymore this frame.
+ */
+CSR_API CSR_INLINE void csr_render_resolve(csr_context *context)
+{
+  int tile_x, tile_y, end_x, y;
+
+  if (!context->clear_pending)
+  {
+    return;
+  }
+
+  for (tile_y = 0; tile_y < context->tiles_y; ++tile_y)
+  {
+    unsigned char *flags = &context->clear_tiles[tile_y * context->tiles_x];
+    int min_y = tile_y * CSR_TILE_SIZE;
+    int end_y = csr_mini(min_y + CSR_TILE_SIZE, context->height);
+
+    for (tile_x = 0; tile_x < context->tiles_x; tile_x = end_x)
+    {
+      int min_x = tile_x * CSR_TILE_SIZE;
+
+      for (end_x = tile_x; end_x < context->tiles_x && flags[end_x]; ++end_x)
+      {
+        flags[end_x] = 0;
+      }
+
+      if (end_x == tile_x)
+      {
+        end_x++;
+        continue;
+      }
+
+      for (y = min_y; y < end_y; ++y)
+      {
+        context->kernels.clear(context, y * context->width + min_x, csr_mini(end_x * CSR_TILE_SIZE, context->width) - min_x, context->clear_color, 1);
+      }
+    }
+  }
+
+  context->clear_pending = 0;
+}
+
+/* Draws a line with depth testing using Bresenham's algorithm. */
+CSR_API CSR_INLINE unsigned long csr_kernel_line_scalar(csr_context *context, float p0[3], float p1[3], csr_color color)
+{
+  unsigned long samples = 0;
+  int counting = context->query_active;
+  int x0 = (int)p0[0], y0 = (int)p0[1];
+  int x1 = (int)p1[0], y1 = (int)p1[1];
+  float z0 = p0[2], z1 = p1[2];
+
+  int dx = csr_absi(x1 - x0);
+  int sx = x0 < x1 ? 1 : -1;
+  int dy = -csr_absi(y1 - y0);
+  int sy = y0 < y1 ? 1 : -1;
+
+  int err = dx + dy, e2;
+  float z = z0;
+  float dz = (float)(dx > -dy ? dx : -dy);
+
+  dz = (dz == 0) ? 0.0f : (z1 - z0) / dz;
+
+  while (1)
+  {
+    if (x0 >= 0 && x0 < context->width && y0 >= 0 && y0 < context->height)
+    {
+      int index = y0 * context->width + x0;
+
+      if (context->overdraw)
+      {
+        context->overdraw[index]++;
+      }
+
+      if (z < context->zbuffer[index])
+      {
+        context->framebuffer[index] = color;
+        context->zbuffer[index] = z;
+        samples += (unsigned long)counting;
+
+        /* Lines are colored directly, the resolve pass keeps their pixels */
+        if (context->visibility_active)
+        {
+          context->visibility[index] = CSR_VISIBILITY_EMPTY;
+        }
+      }
+    }
+
+    if (x0 == x1 && y0 == y1)
+    {
+      return samples;
+    }
+
+    e2 = 2 * err;
+
+    if (e2 >= dy)
+    {
+      err += dy;
+      x0 += sx;
+      z += dz;
+    }
+
+    if (e2 <= dx)
+    {
+      err += dx;
+      y0 += sy;
+      z += dz;
+    }
+  }
+}
+
+CSR_API CSR_INLINE void csr_draw_line(csr_context *context, float p0[3], float p1[3], csr_color color)
+{
+  /* Lines are drawn right away, the tiles they cross are filled first if their fast clear is pending */
+  csr_clear_rect(context, (int)csr_minf(p0[0], p1[0]), (int)csr_minf(p0[1], p1[1]), (int)csr_maxf(p0[0], p1[0]), (int)csr_maxf(p0[1], p1[1]));
+
+  context->query_samples[0] += context->kernels.line(context, p0, p1, color);
+}
+
+/* Snaps a screen space coordinate to 28.4 fixed point (round to nearest). */
+CSR_API CSR_INLINE int csr_fixed(float v)
+{
+  float s = v * (float)CSR_SUBPIXEL_STEPS + 0.5f;
+  int i = (int)s;
+
+  return ((float)i > s) ? i - 1 : i;
+}
+
+/* Computes the per triangle constants used by the rasterizer. Returns 0 if the triangle has no area or is off screen. */
+CSR_API CSR_INLINE int csr_triangle_setup(csr_context *context, csr_triangle *tri, float p0[3], float p1[3], float p2[3], csr_color c0, csr_color c1, csr_color c2)
+{
+  int x[3], y[3];
+  float z[3], r[3], g[3], b[3];
+  double area, inv_area;
+  float a_px[3], b_px[3];
+  float ref_x, ref_y;
+  int min_fx, min_fy, max_fx, max_fy;
+  int i;
+
+  if (!context->mesh_inside &&
+      (csr_maxf(csr_maxf(csr_absf(p0[0]), csr_absf(p0[1])), csr_maxf(csr_absf(p1[0]), csr_absf(p1[1]))) > CSR_GUARD_BAND ||
+       csr_maxf(csr_absf(p2[0]), csr_absf(p2[1])) > CSR_GUARD_BAND))
+  {
+    CSR_STATS_ADD(&context->stats[0], triangles_offscreen, 1);
+    return 0;
+  }
+
+  x[0] = csr_fixed(p0[0]);
+  y[0] = csr_fixed(p0[1]);
+  x[1] = csr_fixed(p1[0]);
+  y[1] = csr_fixed(p1[1]);
+  x[2] = csr_fixed(p2[0]);
+  y[2] = csr_fixed(p2[1]);
+
+  /* Twice the signed area in fixed point squared units */
+  area = (double)(x[1] - x[0]) * (double)(y[2] - y[0]) - (double)(y[1] - y[0]) * (double)(x[2] - x[0]);
+
+  if (area == 0.0)
+  {
+    CSR_STATS_ADD(&context->stats[0], triangles_degenerate, 1);
+    return 0;
+  }
+
+  tri->id = context->visibility_id;
+
+  z[0] = p0[2];
+  r[0] = (float)c0.r;
+  g[0] = (float)c0.g;
+  b[0] = (float)c0.b;
+
+  /* Bring the vertices into an order where the inside of every edge function is positive */
+  if (area > 0.0)
+  {
+    z[1] = p1[2], r[1] = (float)c1.r, g[1] = (float)c1.g, b[1] = (float)c1.b;
+    z[2] = p2[2], r[2] = (float)c2.r, g[2] = (float)c2.g, b[2] = (float)c2.b;
+  }
+  else
+  {
+    int t;
+
+    t = x[1], x[1] = x[2], x[2] = t;
+    t = y[1], y[1] = y[2], y[2] = t;
+    z[1] = p2[2], r[1] = (float)c2.r, g[1] = (float)c2.g, b[1] = (float)c2.b;
+    z[2] = p1[2], r[2] = (float)c1.r, g[2] = (float)c1.g, b[2] = (float)c1.b;
+    area = -area;
+  }
+
+  tri->z_min = csr_minf(z[0], csr_minf(z[1], z[2]));
+  tri->z_max = csr_maxf(z[0], csr_maxf(z[1], z[2]));
+
+  /* Bounding box of the pixel centers that can be covered, clamped to the screen */
+  min_fx = csr_mini(x[0], csr_mini(x[1], x[2]));
+  min_fy = csr_mini(y[0], csr_mini(y[1], y[2]));
+  max_fx = csr_maxi(x[0], csr_maxi(x[1], x[2]));
+  max_fy = csr_maxi(y[0], csr_maxi(y[1], y[2]));
+
+  if (max_fx < 0 || max_fy < 0)
+  {
+    CSR_STATS_ADD(&context->stats[0], triangles_offscreen, 1);
+    return 0;
+  }
+
+  tri->min_x = min_fx < 0 ? 0 : (min_fx >> CSR_SUBPIXEL_BITS);
+  tri->min_y = min_fy < 0 ? 0 : (min_fy >> CSR_SUBPIXEL_BITS);
+  tri->max_x = csr_mini(context->width - 1, max_fx >> CSR_SUBPIXEL_BITS);
+  tri->max_y = csr_mini(context->height - 1, max_fy >> CSR_SUBPIXEL_BITS);
+
+  if (tri->min_x > tri->max_x || tri->min_y > tri->max_y)
+  {
+    CSR_STATS_ADD(&context->stats[0], triangles_offscreen, 1);
+    return 0;
+  }
+
+  /* Edge i is opposite to vertex i: E0 = (v1, v2), E1 = (v2, v0), E2 = (v0, v1) */
+  for (i = 0; i < 3; ++i)
+  {
+    int v0 = (i + 1) % 3;
+    int v1 = (i + 2) % 3;
+
+    int ea = y[v0] - y[v1];
+    int eb = x[v1] - x[v0];
+
+    /* Top-left rule: pixel centers exactly on an edge only belong to the triangle if it is a left or top edge */
+    int is_top_left = (ea > 0) || (ea == 0 && eb > 0);
+
+    tri->edge_a[i] = ea;
+    tri->edge_b[i] = eb;
+    tri->edge_c[i] = -(double)ea * (double)x[v0] - (double)eb * (double)y[v0] - (is_top_left ? 0.0 : 1.0);
+
+    /* Edge function gradients in pixel units used for the attribute planes */
+    a_px[i] = (float)ea * (float)CSR_SUBPIXEL_STEPS;
+    b_px[i] = (float)eb * (float)CSR_SUBPIXEL_STEPS;
+  }
+
+  /* Attribute planes: attr = attr0 + (attr1 - attr0) * w1 + (attr2 - attr0) * w2 with wi = Ei / area */
+  inv_area = 1.0 / area;
+  ref_x = (float)tri->min_x + 0.5f - (float)x[0] / (float)CSR_SUBPIXEL_STEPS;
+  ref_y = (float)tri->min_y + 0.5f - (float)y[0] / (float)CSR_SUBPIXEL_STEPS;
+
+  {
+    float w1_dx = (float)((double)a_px[1] * inv_area);
+    float w1_dy = (float)((double)b_px[1] * inv_area);
+    float w2_dx = (float)((double)a_px[2] * inv_area);
+    float w2_dy = (float)((double)b_px[2] * inv_area);
+
+    tri->z_dx = (z[1] - z[0]) * w1_dx + (z[2] - z[0]) * w2_dx;
+    tri->z_dy = (z[1] - z[0]) * w1_dy + (z[2] - z[0]) * w2_dy;
+    tri->z = z[0] + tri->z_dx * ref_x + tri->z_dy * ref_y;
+
+    tri->r_dx = (r[1] - r[0]) * w1_dx + (r[2] - r[0]) * w2_dx;
+    tri->r_dy = (r[1] - r[0]) * w1_dy + (r[2] - r[0]) * w2_dy;
+    tri->r = r[0] + tri->r_dx * ref_x + tri->r_dy * ref_y;
+
+    tri->g_dx = (g[1] - g[0]) * w1_dx + (g[2] - g[0]) * w2_dx;
+    tri->g_dy = (g[1] - g[0]) * w1_dy + (g[2] - g[0]) * w2_dy;
+    tri->g = g[0] + tri->g_dx * ref_x + tri->g_dy * ref_y;
+
+    tri->b_dx = (b[1] - b[0]) * w1_dx + (b[2] - b[0]) * w2_dx;
+    tri->b_dy = (b[1] - b[0]) * w1_dy + (b[2] - b[0]) * w2_dy;
+    tri->b = b[0] + tri->b_dx * ref_x + tri->b_dy * ref_y;
+  }
+
+#ifdef CSR_ENABLE_STATS
+  {
+    /* area is twice the triangle area in 1/16 pixel units */
+    double pixels = (area < 0.0 ? -area : area) / (2.0 * (double)(CSR_SUBPIXEL_STEPS * CSR_SUBPIXEL_STEPS));
+    int bin = 0;
+
+    while (bin + 1 < CSR_STATS_AREA_BINS && pixels >= (double)(1UL << bin))
+    {
+      bin++;
+    }
+
+    context->stats[0].triangles_rasterized++;
+    context->stats[0].triangle_areas[bin]++;
+  }
+#endif
+
+  return 1;
+}
+
+/* Steps the edge functions with integer adds and the attributes with their gradients to the next row. */
+CSR_API CSR_INLINE void csr_raster_rect_next_row(csr_raster_rect *rect, csr_triangle *tri)
+{
+  rect->e_row[0] += rect->e_dy[0];
+  rect->e_row[1] += rect->e_dy[1];
+  rect->e_row[2] += rect->e_dy[2];
+  rect->z_row += tri->z_dy;
+  rect->r_row += tri->r_dy;
+  rect->g_row += tri->g_dy;
+  rect->b_row += tri->b_dy;
+}
+
+/* Rasterizes the pixels from x to the end of the span of row y (in block row block_row) one at a time. */
+CSR_API CSR_INLINE unsigned long csr_raster_row_scalar(csr_context *context, csr_triangle *tri, csr_raster_rect *rect, int block_row, int y, int x)
+{
+  unsigned long samples = 0;
+  int counting = context->query_active;
+  int max_x = rect->span_max_x[block_row];
+  int covered_min_x = rect->covered_min_x[block_row];
+  int covered_max_x = rect->covered_max_x[block_row];
+  int index_row = y * context->width;
+  int depth_only = context->mode == CSR_RENDER_DEPTH_ONLY;
+  int depth_equal = context->mode == CSR_RENDER_DEPTH_EQUAL;
+  int visibility = context->visibility_active;
+
+  CSR_STATS_ADD(rect->stats, pixels_visited, csr_maxi(max_x - x + 1, 0));
+
+  for (; x <= max_x; ++x)
+  {
+    int i_x = x - rect->min_x;
+    int index = index_row + x;
+
+    /* The pixel is covered if its block is fully covered or no edge function is negative */
+    if ((x >= covered_min_x && x <= covered_max_x) ||
+        ((rect->e_row[0] + rect->e_dx[0] * i_x) | (rect->e_row[1] + rect->e_dx[1] * i_x) | (rect->e_row[2] + rect->e_dx[2] * i_x)) >= 0)
+    {
+      float z = rect->z_row + tri->z_dx * (float)i_x;
+      float depth = context->zbuffer[index];
+
+      CSR_STATS_ADD(rect->stats, pixels_covered, 1);
+
+      /* Depth testing: only draw if the new pixel is closer than the existing one (the same after a depth prepass) */
+      if (depth_equal ? z == depth : z < depth)
+      {
+        CSR_STATS_ADD(rect->stats, pixels_passed, 1);
+        CSR_STATS_ADD(rect->stats, pixels_written, !depth_only);
+
+        if (!depth_only && visibility)
+        {
+          context->visibility[index] = tri->id;
+        }
+        else if (!depth_only)
+        {
+          csr_color pixel_color;
+          pixel_color.r = (unsigned char)(int)(rect->r_row + tri->r_dx * (float)i_x);
+          pixel_color.g = (unsigned char)(int)(rect->g_row + tri->g_dx * (float)i_x);
+          pixel_color.b = (unsigned char)(int)(rect->b_row + tri->b_dx * (float)i_x);
+
+          context->framebuffer[index] = pixel_color;
+        }
+
+        if (!depth_equal)
+        {
+          context->zbuffer[index] = z;
+        }
+
+        samples += (unsigned long)counting;
+      }
+    }
+  }
+
+  return samples;
+}
+
+CSR_API CSR_INLINE unsigned long csr_kernel_raster_scalar(csr_context *context, csr_triangle *tri, csr_raster_rect *rect)
+{
+  unsigned long samples = 0;
+  int block_row, y;
+
+  for (block_row = 0, y = rect->min_y; y <= rect->max_y; ++block_row)
+  {
+    int row_max_y = rect->classified ? csr_mini(y | (CSR_BLOCK_SIZE - 1), rect->max_y) : rect->max_y;
+
+    for (; y <= row_max_y; ++y)
+    {
+      samples += csr_raster_row_scalar(context, tri, rect, block_row, y, rect->span_min_x[block_row]);
+      csr_raster_rect_next_row(rect, tri);
+    }
+  }
+
+  return samples;
+}
+
+#ifdef CSR_HAS_SSE2
+/* Compacts the lower 3 bytes of four 32 bit lanes into 12 consecutive bytes (the upper 4 bytes are zero). */
+CSR_API CSR_INLINE __m128i csr_sse_pack_rgb(__m128i v)
+{
+  __m128i lane0 = _mm_and_si128(v, _mm_set_epi32(0, 0, 0, 0x00ffffff));
+  __m128i lane1 = _mm_srli_si128(_mm_and_si128(v, _mm_set_epi32(0, 0, 0x00ffffff, 0)), 1);
+  __m128i lane2 = _mm_srli_si128(_mm_and_si128(v, _mm_set_epi32(0, 0x00ffffff, 0, 0)), 2);
+  __m128i lane3 = _mm_srli_si128(_mm_and_si128(v, _mm_set_epi32(0x00ffffff, 0, 0, 0)), 3);
+
+  return _mm_or_si128(_mm_or_si128(lane0, lane1), _mm_or_si128(lane2, lane3));
+}
+
+/* Writes the 0xbbggrr packed colors of the 4 pixels starting at pixels whose bit is set in bits.
+ * If wide is set the 16 bytes at pixels lie inside the rectangle and are blended with one load/store.
+ */
+CSR_API CSR_INLINE void csr_sse_store_rgb(csr_color *pixels, __m128i rgb, __m128i mask, int bits, int wide)
+{
+  if (wide)
+  {
+    __m128i *target = (__m128i *)pixels;
+    __m128i byte_mask = csr_sse_pack_rgb(mask);
+    __m128i old = _mm_loadu_si128(target);
+
+    _mm_storeu_si128(target, _mm_or_si128(_mm_and_si128(byte_mask, csr_sse_pack_rgb(rgb)), _mm_andnot_si128(byte_mask, old)));
+  }
+  else
+  {
+    int packed[4];
+    int k;
+
+    _mm_storeu_si128((__m128i *)packed, rgb);
+
+    for (k = 0; k < 4; ++k)
+    {
+      if (bits & (1 << k))
+      {
+        pixels[k].r = (unsigned char)(packed[k] & 0xff);
+        pixels[k].g = (unsigned char)((packed[k] >> 8) & 0xff);
+        pixels[k].b = (unsigned char)((packed[k] >> 16) & 0xff);
+      }
+    }
+  }
+}
+
+/* Evaluates 4 pixels per iteration. The attributes use the same row base + gradient * offset
+ * formula as the scalar kernel so both produce identical results.
+ */
+CSR_API CSR_INLINE unsigned long csr_kernel_raster_sse2(csr_context *context, csr_triangle *tri, csr_raster_rect *rect)
+{
+  __m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+  __m128i e0_step = _mm_set1_epi32(rect->e_dx[0] * 4);
+  __m128i e1_step = _mm_set1_epi32(rect->e_dx[1] * 4);
+  __m128i e2_step = _mm_set1_epi32(rect->e_dx[2] * 4);
+  __m128i minus_one = _mm_set1_epi32(-1);
+  __m128 offset_step = _mm_set1_ps(4.0f);
+  __m128 z_dx = _mm_set1_ps(tri->z_dx);
+  __m128 r_dx = _mm_set1_ps(tri->r_dx);
+  __m128 g_dx = _mm_set1_ps(tri->g_dx);
+  __m128 b_dx = _mm_set1_ps(tri->b_dx);
+  __m128i id = _mm_set1_epi32((int)tri->id);
+  int depth_only = context->mode == CSR_RENDER_DEPTH_ONLY;
+  int depth_equal = context->mode == CSR_RENDER_DEPTH_EQUAL;
+  int visibility = context->visibility_active;
+  int counting = context->query_active;
+  unsigned long samples = 0;
+  int block_row, x, y;
+
+  for (block_row = 0, y = rect->min_y; y <= rect->max_y; ++block_row)
+  {
+    int row_max_y = rect->classified ? csr_mini(y | (CSR_BLOCK_SIZE - 1), rect->max_y) : rect->max_y;
+    int min_x = rect->span_min_x[block_row];
+    int max_x = rect->span_max_x[block_row];
+    int covered_min_x = rect->covered_min_x[block_row];
+    int covered_max_x = rect->covered_max_x[block_row];
+
+    /* Edge function offsets of the first 4 pixels of the span to min_x, SSE2 has no 32 bit multiply */
+    int i_x = min_x - rect->min_x;
+    __m128i e0_lanes = _mm_set_epi32((i_x + 3) * rect->e_dx[0], (i_x + 2) * rect->e_dx[0], (i_x + 1) * rect->e_dx[0], i_x * rect->e_dx[0]);
+    __m128i e1_lanes = _mm_set_epi32((i_x + 3) * rect->e_dx[1], (i_x + 2) * rect->e_dx[1], (i_x + 1) * rect->e_dx[1], i_x * rect->e_dx[1]);
+    __m128i e2_lanes = _mm_set_epi32((i_x + 3) * rect->e_dx[2], (i_x + 2) * rect->e_dx[2], (i_x + 1) * rect->e_dx[2], i_x * rect->e_dx[2]);
+    __m128 offset_lanes = _mm_cvtepi32_ps(_mm_add_epi32(lanes, _mm_set1_epi32(i_x)));
+
+    for (; y <= row_max_y; ++y)
+    {
+      int index_row = y * context->width;
+
+      __m128i e0 = _mm_add_epi32(_mm_set1_epi32(rect->e_row[0]), e0_lanes);
+      __m128i e1 = _mm_add_epi32(_mm_set1_epi32(rect->e_row[1]), e1_lanes);
+      __m128i e2 = _mm_add_epi32(_mm_set1_epi32(rect->e_row[2]), e2_lanes);
+
+      __m128 offset = offset_lanes;
+      __m128 z_base = _mm_set1_ps(rect->z_row);
+      __m128 r_base = _mm_set1_ps(rect->r_row);
+      __m128 g_base = _mm_set1_ps(rect->g_row);
+      __m128 b_base = _mm_set1_ps(rect->b_row);
+
+      for (x = min_x; x + 3 <= max_x; x += 4)
+      {
+        int index = index_row + x;
+
+        /* Covered if the 4 pixels lie in fully covered blocks or no edge function is negative */
+        __m128i edges = _mm_or_si128(_mm_or_si128(e0, e1), e2);
+        __m128 mask = _mm_castsi128_ps((x >= covered_min_x && x + 3 <= covered_max_x) ? minus_one : _mm_cmpgt_epi32(edges, minus_one));
+
+        CSR_STATS_ADD(rect->stats, pixels_visited, 4);
+
+        if (_mm_movemask_ps(mask))
+        {
+          __m128 z = _mm_add_ps(z_base, _mm_mul_ps(z_dx, offset));
+          __m128 depth = _mm_loadu_ps(&context->zbuffer[index]);
+          int bits;
+
+          CSR_STATS_ADD(rect->stats, pixels_covered, csr_bit_count8(_mm_movemask_ps(mask)));
+
+          /* Depth testing: only draw if the new pixel is closer than the existing one (the same after a depth prepass) */
+          mask = _mm_and_ps(mask, depth_equal ? _mm_cmpeq_ps(z, depth) : _mm_cmplt_ps(z, depth));
+          bits = _mm_movemask_ps(mask);
+
+          CSR_STATS_ADD(rect->stats, pixels_passed, csr_bit_count8(bits));
+          CSR_STATS_ADD(rect->stats, pixels_written, depth_only ? 0 : csr_bit_count8(bits));
+
+          if (counting)
+          {
+            samples += (unsigned long)csr_bit_count8(bits);
+          }
+
+          if (bits && !depth_equal)
+          {
+            _mm_storeu_ps(&context->zbuffer[index], _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, depth)));
+          }
+
+          if (bits && !depth_only && visibility)
+          {
+            __m128i *target = (__m128i *)&context->visibility[index];
+            __m128i mask_i = _mm_castps_si128(mask);
+
+            _mm_storeu_si128(target, _mm_or_si128(_mm_and_si128(mask_i, id), _mm_andnot_si128(mask_i, _mm_loadu_si128(target))));
+          }
+          else if (bits && !depth_only)
+          {
+            __m128i rgb;
+
+            /* Pack the colors into 0xbbggrr per lane */
+            rgb = _mm_cvttps_epi32(_mm_add_ps(r_base, _mm_mul_ps(r_dx, offset)));
+            rgb = _mm_or_si128(rgb, _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(g_base, _mm_mul_ps(g_dx, offset))), 8));
+            rgb = _mm_or_si128(rgb, _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(b_base, _mm_mul_ps(b_dx, offset))), 16));
+
+            csr_sse_store_rgb(&context->framebuffer[index], rgb, _mm_castps_si128(mask), bits, x + 5 <= rect->max_x);
+          }
+        }
+
+        e0 = _mm_add_epi32(e0, e0_step);
+        e1 = _mm_add_epi32(e1, e1_step);
+        e2 = _mm_add_epi32(e2, e2_step);
+        offset = _mm_add_ps(offset, offset_step);
+      }
+
+      samples += csr_raster_row_scalar(context, tri, rect, block_row, y, x);
+      csr_raster_rect_next_row(rect, tri);
+    }
+  }
+
+  return samples;
+}
+#endif
+
+#ifdef CSR_HAS_AVX2
+/* Evaluates 8 pixels per iteration. The last pixels of a row are handled with a lane mask and
+ * masked depth loads/stores instead of a scalar loop. Results are identical to the other kernels.
+ */
+CSR_API CSR_INLINE CSR_TARGET_AVX2 unsigned long csr_kernel_raster_avx2(csr_context *context, csr_triangle *tri, csr_raster_rect *rect)
+{
+  __m256i lanes = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+  __m256i lanes_step = _mm256_set1_epi32(8);
+  __m256i e0_dx = _mm256_set1_epi32(rect->e_dx[0]);
+  __m256i e1_dx = _mm256_set1_epi32(rect->e_dx[1]);
+  __m256i e2_dx = _mm256_set1_epi32(rect->e_dx[2]);
+  __m256i e0_step = _mm256_set1_epi32(rect->e_dx[0] * 8);
+  __m256i e1_step = _mm256_set1_epi32(rect->e_dx[1] * 8);
+  __m256i e2_step = _mm256_set1_epi32(rect->e_dx[2] * 8);
+  __m256i minus_one = _mm256_set1_epi32(-1);
+  __m256 offset_step = _mm256_set1_ps(8.0f);
+  __m256 z_dx = _mm256_set1_ps(tri->z_dx);
+  __m256 r_dx = _mm256_set1_ps(tri->r_dx);
+  __m256 g_dx = _mm256_set1_ps(tri->g_dx);
+  __m256 b_dx = _mm256_set1_ps(tri->b_dx);
+  __m256i id = _mm256_set1_epi32((int)tri->id);
+  int depth_only = context->mode == CSR_RENDER_DEPTH_ONLY;
+  int depth_equal = context->mode == CSR_RENDER_DEPTH_EQUAL;
+  int visibility = context->visibility_active;
+  int counting = context->query_active;
+  unsigned long samples = 0;
+  int block_row, x, y;
+
+  for (block_row = 0, y = rect->min_y; y <= rect->max_y; ++block_row)
+  {
+    int row_max_y = rect->classified ? csr_mini(y | (CSR_BLOCK_SIZE - 1), rect->max_y) : rect->max_y;
+    int min_x = rect->span_min_x[block_row];
+    int max_x = rect->span_max_x[block_row];
+    int covered_min_x = rect->covered_min_x[block_row];
+    int covered_max_x = rect->covered_max_x[block_row];
+
+    /* Lanes hold the pixel offsets to rect->min_x, lanes past the end of the span are masked out */
+    __m256i lane_start = _mm256_add_epi32(lanes, _mm256_set1_epi32(min_x - rect->min_x));
+    __m256i lanes_end = _mm256_set1_epi32(max_x - rect->min_x + 1);
+    __m256i e0_lanes = _mm256_mullo_epi32(e0_dx, lane_start);
+    __m256i e1_lanes = _mm256_mullo_epi32(e1_dx, lane_start);
+    __m256i e2_lanes = _mm256_mullo_epi32(e2_dx, lane_start);
+    __m256 offset_lanes = _mm256_cvtepi32_ps(lane_start);
+
+    for (; y <= row_max_y; ++y)
+    {
+      int index_row = y * context->width;
+
+      __m256i lane = lane_start;
+      __m256i e0 = _mm256_add_epi32(_mm256_set1_epi32(rect->e_row[0]), e0_lanes);
+      __m256i e1 = _mm256_add_epi32(_mm256_set1_epi32(rect->e_row[1]), e1_lanes);
+      __m256i e2 = _mm256_add_epi32(_mm256_set1_epi32(rect->e_row[2]), e2_lanes);
+
+      __m256 offset = offset_lanes;
+      __m256 z_base = _mm256_set1_ps(rect->z_row);
+      __m256 r_base = _mm256_set1_ps(rect->r_row);
+      __m256 g_base = _mm256_set1_ps(rect->g_row);
+      __m256 b_base = _mm256_set1_ps(rect->b_row);
+
+      for (x = min_x; x <= max_x; x += 8)
+      {
+        int index = index_row + x;
+
+        /* Covered if the pixels lie in fully covered blocks or no edge function is negative */
+        __m256i edges = _mm256_or_si256(_mm256_or_si256(e0, e1), e2);
+        __m256i coverage = (x >= covered_min_x && x + 7 <= covered_max_x) ? minus_one : _mm256_cmpgt_epi32(edges, minus_one);
+        __m256i inside = _mm256_and_si256(coverage, _mm256_cmpgt_epi32(lanes_end, lane));
+
+        CSR_STATS_ADD(rect->stats, pixels_visited, csr_bit_count8(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(lanes_end, lane)))));
+
+        if (_mm256_movemask_ps(_mm256_castsi256_ps(inside)))
+        {
+          __m256 z = _mm256_add_ps(z_base, _mm256_mul_ps(z_dx, offset));
+          __m256 depth = _mm256_maskload_ps(&context->zbuffer[index], inside);
+          __m256 mask;
+          int bits;
+
+          CSR_STATS_ADD(rect->stats, pixels_covered, csr_bit_count8(_mm256_movemask_ps(_mm256_castsi256_ps(inside))));
+
+          /* Depth testing: only draw if the new pixel is closer than the existing one (the same after a depth prepass) */
+          mask = _mm256_and_ps(_mm256_castsi256_ps(inside), depth_equal ? _mm256_cmp_ps(z, depth, _CMP_EQ_OQ) : _mm256_cmp_ps(z, depth, _CMP_LT_OQ));
+          bits = _mm256_movemask_ps(mask);
+
+          CSR_STATS_ADD(rect->stats, pixels_passed, csr_bit_count8(bits));
+          CSR_STATS_ADD(rect->stats, pixels_written, depth_only ? 0 : csr_bit_count8(bits));
+
+          if (counting)
+          {
+            samples += (unsigned long)csr_bit_count8(bits);
+          }
+
+          if (bits && !depth_equal)
+          {
+            _mm256_maskstore_ps(&context->zbuffer[index], _mm256_castps_si256(mask), z);
+          }
+
+          if (bits && !depth_only && visibility)
+          {
+            _mm256_maskstore_epi32((int *)&context->visibility[index], _mm256_castps_si256(mask), id);
+          }
+          else if (bits && !depth_only)
+          {
+            __m256i mask_i = _mm256_castps_si256(mask);
+            __m256i rgb;
+
+            /* Pack the colors into 0xbbggrr per lane and store them as two groups of 4 pixels */
+            rgb = _mm256_cvttps_epi32(_mm256_add_ps(r_base, _mm256_mul_ps(r_dx, offset)));
+            rgb = _mm256_or_si256(rgb, _mm256_slli_epi32(_mm256_cvttps_epi32(_mm256_add_ps(g_base, _mm256_mul_ps(g_dx, offset))), 8));
+            rgb = _mm256_or_si256(rgb, _mm256_slli_epi32(_mm256_cvttps_epi32(_mm256_add_ps(b_base, _mm256_mul_ps(b_dx, offset))), 16));
+
+            if (bits & 0x0f)
+            {
+              csr_sse_store_rgb(&context->framebuffer[index], _mm256_castsi256_si128(rgb), _mm256_castsi256_si128(mask_i), bits & 0x0f, x + 5 <= rect->max_x);
+            }
+
+            if (bits & 0xf0)
+            {
+              csr_sse_store_rgb(&context->framebuffer[index + 4], _mm256_extracti128_si256(rgb, 1), _mm256_extracti128_si256(mask_i, 1), bits >> 4, x + 9 <= rect->max_x);
+            }
+          }
+        }
+
+        e0 = _mm256_add_epi32(e0, e0_step);
+        e1 = _mm256_add_epi32(e1, e1_step);
+        e2 = _mm256_add_epi32(e2, e2_step);
+        lane = _mm256_add_epi32(lane, lanes_step);
+        offset = _mm256_add_ps(offset, offset_step);
+      }
+
+      csr_raster_rect_next_row(rect, tri);
+    }
+  }
+
+  return samples;
+}
+#endif
+
+/* Counts the pixels of a screen rectangle covered by a triangle in the overdraw buffer, before any depth test or
+ * hierarchical depth rejection. Uses the exact edge functions of the raster kernels.
+ */
+CSR_API CSR_INLINE void csr_overdraw_count(csr_context *context, csr_triangle *tri, int min_x, int min_y, int max_x, int max_y)
+{
+  double e_row[3];
+  int i, x, y;
+
+  for (i = 0; i < 3; ++i)
+  {
+    e_row[i] = (double)tri->edge_a[i] * (double)(min_x * CSR_SUBPIXEL_STEPS + CSR_SUBPIXEL_STEPS / 2) +
+               (double)tri->edge_b[i] * (double)(min_y * CSR_SUBPIXEL_STEPS + CSR_SUBPIXEL_STEPS / 2) +
+               tri->edge_c[i];
+  }
+
+  for (y = min_y; y <= max_y; ++y)
+  {
+    unsigned int *counts = &context->overdraw[y * context->width];
+    double e0 = e_row[0], e1 = e_row[1], e2 = e_row[2];
+
+    for (x = min_x; x <= max_x; ++x)
+    {
+      if (e0 >= 0.0 && e1 >= 0.0 && e2 >= 0.0)
+      {
+        counts[x]++;
+      }
+
+      e0 += (double)tri->edge_a[0] * (double)CSR_SUBPIXEL_STEPS;
+      e1 += (double)tri->edge_a[1] * (double)CSR_SUBPIXEL_STEPS;
+      e2 += (double)tri->edge_a[2] * (double)CSR_SUBPIXEL_STEPS;
+    }
+
+    for (i = 0; i < 3; ++i)
+    {
+      e_row[i] += (double)tri->edge_b[i] * (double)CSR_SUBPIXEL_STEPS;
+    }
+  }
+}
+
+/* Rasterizes the part of a set up triangle that lies inside the given (inclusive) screen rectangle.
+ * The rectangle must lie inside of a single tile. Returns the pixels counted by an active occlusion query.
+ * worker selects the statistics counters (see CSR_ENABLE_STATS).
+ */
+CSR_API CSR_INLINE unsigned long csr_triangle_raster(csr_context *context, csr_triangle *tri, int min_x, int min_y, int max_x, int max_y, int worker)
+{
+  csr_raster_rect rect;
+  float dx = (float)(min_x - tri->min_x);
+  float dy = (float)(min_y - tri->min_y);
+  float z_tolerance = 0.0f, z_near = 0.0f, z_offset_min, z_offset_max;
+  int tile = (min_y / CSR_TILE_SIZE) * context->tiles_x + min_x / CSR_TILE_SIZE;
+  int offset_min[3], offset_max[3];
+  int i, block_row, block_x, block_y;
+  int touched_first = CSR_BLOCKS_PER_TILE * CSR_BLOCKS_PER_TILE, touched_last = 0;
+  int pixels = (max_x - min_x + 1) * (max_y - min_y + 1);
+  int depth_write = context->mode != CSR_RENDER_DEPTH_EQUAL;
+  int empty = 1;
+
+#ifdef CSR_ENABLE_STATS
+  rect.stats = &context->stats[worker];
+  rect.stats->pixels_bbox += (unsigned long)pixels;
+#else
+  (void)worker;
+#endif
+
+  if (context->overdraw)
+  {
+    csr_overdraw_count(context, tri, min_x, min_y, max_x, max_y);
+  }
+
+  rect.z_row = tri->z + tri->z_dx * dx + tri->z_dy * dy;
+
+  if (context->hiz)
+  {
+    /* Lower bound of the depth of the triangle inside of the rectangle. The tolerance is never zero, so the
+     * bound is below every pixel depth and pixels equal to the stored max. depth are not rejected.
+     */
+    z_tolerance = CSR_HIZ_TOLERANCE * (1.0f + csr_absf(rect.z_row) + csr_absf(tri->z_min) + (csr_absf(tri->z_dx) + csr_absf(tri->z_dy)) * (float)CSR_TILE_SIZE);
+    z_near = rect.z_row + csr_minf(tri->z_dx, 0.0f) * (float)(max_x - min_x) + csr_minf(tri->z_dy, 0.0f) * (float)(max_y - min_y);
+    z_near = csr_maxf(z_near, tri->z_min) - z_tolerance;
+
+    /* The triangle is behind everything drawn in this tile */
+    if (z_near >= context->hiz_tiles[tile])
+    {
+      return 0;
+    }
+  }
+
+  for (i = 0; i < 3; ++i)
+  {
+    /* Evaluate the edge function exactly at the corner pixel centers of the rectangle */
+    double step_x = (double)tri->edge_a[i] * (double)CSR_SUBPIXEL_STEPS;
+    double step_y = (double)tri->edge_b[i] * (double)CSR_SUBPIXEL_STEPS;
+    double e00 = (double)tri->edge_a[i] * (double)(min_x * CSR_SUBPIXEL_STEPS + CSR_SUBPIXEL_STEPS / 2) +
+                 (double)tri->edge_b[i] * (double)(min_y * CSR_SUBPIXEL_STEPS + CSR_SUBPIXEL_STEPS / 2) +
+                 tri->edge_c[i];
+    double e10 = e00 + step_x * (double)(max_x - min_x);
+    double e01 = e00 + step_y * (double)(max_y - min_y);
+    double e11 = e10 + step_y * (double)(max_y - min_y);
+
+    if (e00 < 0.0 && e10 < 0.0 && e01 < 0.0 && e11 < 0.0)
+    {
+      /* The whole rectangle is outside of this edge */
+      return 0;
+    }
+
+    if (e00 >= 0.0 && e10 >= 0.0 && e01 >= 0.0 && e11 >= 0.0)
+    {
+      /* The whole rectangle is inside of this edge, no need to step it */
+      rect.e_row[i] = 0;
+      rect.e_dx[i] = 0;
+      rect.e_dy[i] = 0;
+    }
+    else
+    {
+      /* The edge crosses the rectangle so its values are bounded by the rectangle extent */
+      rect.e_row[i] = (int)e00;
+      rect.e_dx[i] = (int)step_x;
+      rect.e_dy[i] = (int)step_y;
+    }
+  }
+
+  /* First triangle reaching this tile since a fast clear */
+  if (context->clear_pending && context->clear_tiles[tile])
+  {
+    csr_clear_tile(context, tile);
+  }
+
+  rect.min_x = min_x;
+  rect.min_y = min_y;
+  rect.max_x = max_x;
+  rect.max_y = max_y;
+  rect.r_row = tri->r + tri->r_dx * dx + tri->r_dy * dy;
+  rect.g_row = tri->g + tri->g_dx * dx + tri->g_dy * dy;
+  rect.b_row = tri->b + tri->b_dx * dx + tri->b_dy * dy;
+
+  /* Small rectangles are cheaper to test per pixel than to classify */
+  if (pixels <= CSR_BLOCK_CLASSIFY_MIN_PIXELS)
+  {
+    rect.classified = 0;
+    rect.span_min_x[0] = min_x;
+    rect.span_max_x[0] = max_x;
+    rect.covered_min_x[0] = max_x + 1;
+    rect.covered_max_x[0] = max_x;
+
+    if (context->hiz && pixels >= CSR_HIZ_MIN_PIXELS && !csr_hiz_test_rect(context, tile, min_x, min_y, max_x, max_y, z_near, depth_write))
+    {
+      return 0;
+    }
+
+    return context->kernels.raster(context, tri, &rect);
+  }
+
+  rect.classified = 1;
+
+  /* Smallest and largest depth offset inside a block relative to its top left pixel */
+  z_offset_min = csr_minf(tri->z_dx, 0.0f) * (float)(CSR_BLOCK_SIZE - 1) + csr_minf(tri->z_dy, 0.0f) * (float)(CSR_BLOCK_SIZE - 1);
+  z_offset_max = csr_maxf(tri->z_dx, 0.0f) * (float)(CSR_BLOCK_SIZE - 1) + csr_maxf(tri->z_dy, 0.0f) * (float)(CSR_BLOCK_SIZE - 1);
+
+  /* Largest and smallest offset of an edge function inside a block relative to its top left pixel */
+  for (i = 0; i < 3; ++i)
+  {
+    offset_max[i] = csr_maxi(rect.e_dx[i], 0) * (CSR_BLOCK_SIZE - 1) + csr_maxi(rect.e_dy[i], 0) * (CSR_BLOCK_SIZE - 1);
+    offset_min[i] = csr_mini(rect.e_dx[i], 0) * (CSR_BLOCK_SIZE - 1) + csr_mini(rect.e_dy[i], 0) * (CSR_BLOCK_SIZE - 1);
+  }
+
+  /* Classify the screen aligned blocks by the edge values at their corners. Edge functions are
+   * linear, so along a block row the blocks touching the triangle form one interval and the
+   * fully covered blocks a sub interval of it. Blocks hidden by the hierarchical depth are
+   * skipped like blocks outside of the triangle, hidden blocks between visible ones stay part
+   * of the interval and are rejected per pixel.
+   */
+  for (block_row = 0, block_y = min_y & ~(CSR_BLOCK_SIZE - 1); block_y <= max_y; ++block_row, block_y += CSR_BLOCK_SIZE)
+  {
+    int block_x0 = min_x & ~(CSR_BLOCK_SIZE - 1);
+    float z_block = rect.z_row + tri->z_dx * (float)(block_x0 - min_x) + tri->z_dy * (float)(block_y - min_y);
+    int block = ((block_y % CSR_TILE_SIZE) / CSR_BLOCK_SIZE) * CSR_BLOCKS_PER_TILE + (block_x0 % CSR_TILE_SIZE) / CSR_BLOCK_SIZE;
+    int hiz_block = tile * CSR_BLOCKS_PER_TILE * CSR_BLOCKS_PER_TILE + block;
+    int inside_y = block_y >= min_y && csr_mini(block_y + CSR_BLOCK_SIZE, context->height) - 1 <= max_y;
+    int e[3];
+
+    rect.span_min_x[block_row] = max_x + 1;
+    rect.span_max_x[block_row] = max_x;
+    rect.covered_min_x[block_row] = max_x + 1;
+    rect.covered_max_x[block_row] = max_x;
+
+    /* Edge functions at the top left pixel of the first block, which may lie outside of the rectangle */
+    for (i = 0; i < 3; ++i)
+    {
+      e[i] = rect.e_row[i] + rect.e_dx[i] * (block_x0 - min_x) + rect.e_dy[i] * (block_y - min_y);
+    }
+
+    for (block_x = block_x0; block_x <= max_x; block_x += CSR_BLOCK_SIZE, ++block, ++hiz_block)
+    {
+      int outside = (e[0] + offset_max[0] < 0) | (e[1] + offset_max[1] < 0) | (e[2] + offset_max[2] < 0);
+      int covered = (e[0] + offset_min[0] >= 0) & (e[1] + offset_min[1] >= 0) & (e[2] + offset_min[2] >= 0);
+      float z = z_block;
+
+      e[0] += rect.e_dx[0] * CSR_BLOCK_SIZE;
+      e[1] += rect.e_dx[1] * CSR_BLOCK_SIZE;
+      e[2] += rect.e_dx[2] * CSR_BLOCK_SIZE;
+      z_block += tri->z_dx * (float)CSR_BLOCK_SIZE;
+
+      if (outside)
+      {
+        continue;
+      }
+
+      if (context->hiz)
+      {
+        if (csr_maxf(z + z_offset_min, tri->z_min) - z_tolerance >= context->hiz[hiz_block])
+        {
+          continue;
+        }
+
+        /* Every pixel of a fully covered block inside of the rectangle ends up at most as far as the
+         * triangle, which bounds its new max. depth without reading it back. Other blocks are
+         * recomputed from the zbuffer once the tile is done.
+         */
+        if (depth_write)
+        {
+          if (covered && inside_y && block_x >= min_x && csr_mini(block_x + CSR_BLOCK_SIZE, context->width) - 1 <= max_x)
+          {
+            context->hiz[hiz_block] = csr_minf(context->hiz[hiz_block], csr_minf(z + z_offset_max, tri->z_max) + z_tolerance);
+          }
+          else
+          {
+            context->hiz_dirty[hiz_block] = 1;
+          }
+
+          touched_first = csr_mini(touched_first, block);
+          touched_last = block;
+        }
+      }
+
+      if (rect.span_min_x[block_row] > max_x)
+      {
+        rect.span_min_x[block_row] = csr_maxi(block_x, min_x);
+      }
+
+      rect.span_max_x[block_row] = csr_mini(block_x + CSR_BLOCK_SIZE - 1, max_x);
+      empty = 0;
+
+      if (covered)
+      {
+        if (rect.covered_min_x[block_row] > max_x)
+        {
+          rect.covered_min_x[block_row] = csr_maxi(block_x, min_x);
+        }
+
+        rect.covered_max_x[block_row] = csr_mini(block_x + CSR_BLOCK_SIZE - 1, max_x);
+      }
+    }
+  }
+
+  if (!empty)
+  {
+    if (context->hiz && depth_write)
+    {
+      csr_hiz_touch(context, tile, touched_first, touched_last);
+    }
+
+    return context->kernels.raster(context, tri, &rect);
+  }
+
+  return 0;
+}
+
+#ifdef CSR_HAS_AVX2
+/* Returns 1 if the CPU and the operating system support AVX2. */
+CSR_API CSR_INLINE int csr_cpu_has_avx2(void)
+{
+  unsigned int eax, ebx, ecx, edx;
+  unsigned int xcr0_lo, xcr0_hi;
+
+  __asm__ __volatile__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0), "c"(0));
+
+  if (eax < 7)
+  {
+    return 0;
+  }
+
+  /* AVX and OSXSAVE, otherwise the OS does not save the upper YMM halves on context switches */
+  __asm__ __volatile__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1), "c"(0));
+
+  if ((ecx & (1u << 27)) == 0 || (ecx & (1u << 28)) == 0)
+  {
+    return 0;
+  }
+
+  __asm__ __volatile__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+
+  if ((xcr0_lo & 6u) != 6u)
+  {
+    return 0;
+  }
+
+  __asm__ __volatile__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
+
+  return (ebx & (1u << 5)) != 0;
+}
+#endif
+
+/* Returns the widest SIMD level that is compiled in and supported by the running CPU. */
+CSR_API CSR_INLINE csr_simd_level csr_cpu_simd_level(void)
+{
+#ifdef CSR_HAS_AVX2
+  if (csr_cpu_has_avx2())
+  {
+    return CSR_SIMD_AVX2;
+  }
+#endif
+
+#ifdef CSR_HAS_SSE2
+  return CSR_SIMD_SSE2;
+#else
+  return CSR_SIMD_SCALAR;
+#endif
+}
+
+/* Fills the kernel table with the kernels of the given SIMD level, limited to what the CPU
+ * supports. csr_init_model selects the widest level, a lower one can be forced for testing.
+ * Returns the selected level.
+ */
+CSR_API CSR_INLINE csr_simd_level csr_set_simd_level(csr_context *context, csr_simd_level level)
+{
+  csr_simd_level supported = csr_cpu_simd_level();
+
+  if (level > supported)
+  {
+    level = supported;
+  }
+
+  context->kernels.level = CSR_SIMD_SCALAR;
+  context->kernels.clear = csr_kernel_clear_scalar;
+  context->kernels.transform = csr_kernel_transform_scalar;
+  context->kernels.raster = csr_kernel_raster_scalar;
+  context->kernels.line = csr_kernel_line_scalar;
+
+#ifdef CSR_HAS_SSE2
+  if (level >= CSR_SIMD_SSE2)
+  {
+    context->kernels.level = CSR_SIMD_SSE2;
+    context->kernels.clear = csr_kernel_clear_sse2;
+    context->kernels.transform = csr_kernel_transform_sse2;
+    context->kernels.raster = csr_kernel_raster_sse2;
+  }
+#endif
+
+#ifdef CSR_HAS_AVX2
+  if (level >= CSR_SIMD_AVX2)
+  {
+    context->kernels.level = CSR_SIMD_AVX2;
+    context->kernels.transform = csr_kernel_transform_avx2;
+    context->kernels.raster = csr_kernel_raster_avx2;
+  }
+#endif
+
+  return context->kernels.level;
+}
+
+/* Recomputes the max. depth of the blocks of a tile written since the last update and of the tile itself. */
+CSR_API CSR_INLINE void csr_hiz_update_tile(csr_context *context, int tile)
+{
+  int tile_x = (tile % context->tiles_x) * CSR_TILE_SIZE;
+  int tile_y = (tile / context->tiles_x) * CSR_TILE_SIZE;
+  float *hiz = &context->hiz[tile * CSR_BLOCKS_PER_TILE * CSR_BLOCKS_PER_TILE];
+  unsigned char *dirty = &context->hiz_dirty[tile * CSR_BLOCKS_PER_TILE * CSR_BLOCKS_PER_TILE];
+  unsigned char *range = &context->hiz_tiles_dirty[tile * 2];
+  float tile_depth = -CSR_DEPTH_UNKNOWN;
+  int block, x, y;
+
+  if (range[0] > range[1])
+  {
+    return;
+  }
+
+  for (block = range[0]; block <= range[1]; ++block)
+  {
+    if (dirty[block])
+    {
+      int block_x = tile_x + (block % CSR_BLOCKS_PER_TILE) * CSR_BLOCK_SIZE;
+      int block_y = tile_y + (block / CSR_BLOCKS_PER_TILE) * CSR_BLOCK_SIZE;
+      int end_x = csr_mini(block_x + CSR_BLOCK_SIZE, context->width);
+      int end_y = csr_mini(block_y + CSR_BLOCK_SIZE, context->height);
+      float depth = -CSR_DEPTH_UNKNOWN;
+
+      for (y = block_y; y < end_y; ++y)
+      {
+        float *row = &context->zbuffer[y * context->width];
+
+        if (end_x - block_x == CSR_BLOCK_SIZE)
+        {
+          depth = csr_maxf(depth, csr_max8f(&row[block_x]));
+          continue;
+        }
+
+        for (x = block_x; x < end_x; ++x)
+        {
+          depth = csr_maxf(depth, row[x]);
+        }
+      }
+
+      hiz[block] = depth;
+      dirty[block] = 0;
+    }
+  }
+
+  for (block = 0; block < CSR_BLOCKS_PER_TILE * CSR_BLOCKS_PER_TILE; block += 8)
+  {
+    tile_depth = csr_maxf(tile_depth, csr_max8f(&hiz[block]));
+  }
+
+  context->hiz_tiles[tile] = tile_depth;
+  range[0] = CSR_BLOCKS_PER_TILE * CSR_BLOCKS_PER_TILE;
+  range[1] = 0;
+}
+
+/* Rasterizes a set up triangle over its whole bounding box tile by tile. */
+CSR_API CSR_INLINE void csr_triangle_raster_all(csr_context *context, csr_triangle *tri)
+{
+  int x, y;
+
+  for (y = tri->min_y & ~(CSR_TILE_SIZE - 1); y <= tri->max_y; y += CSR_TILE_SIZE)
+  {
+    for (x = tri->min_x & ~(CSR_TILE_SIZE - 1); x <= tri->max_x; x += CSR_TILE_SIZE)
+    {
+      context->query_samples[0] += csr_triangle_raster(
+          context, tri,
+          csr_maxi(x, tri->min_x), csr_maxi(y, tri->min_y),
+          csr_mini(x + CSR_TILE_SIZE - 1, tri->max_x), csr_mini(y + CSR_TILE_SIZE - 1, tri->max_y), 0);
+
+      if (context->hiz)
+      {
+        csr_hiz_update_tile(context, (y / CSR_TILE_SIZE) * context->tiles_x + x / CSR_TILE_SIZE);
+      }
+    }
+  }
+}
+
+/* Fills a triangle using integer half-space edge functions with color interpolation. */
+CSR_API CSR_INLINE void csr_draw_triangle(csr_context *context, float p0[3], float p1[3], float p2[3], csr_color c0, csr_color c1, csr_color c2)
+{
+  csr_triangle tri;
+
+  if (csr_triangle_setup(context, &tri, p0, p1, p2, c0, c1, c2))
+  {
+    CSR_TIMER_LAP(context, CSR_STAGE_SETUP);
+    csr_triangle_raster_all(context, &tri);
+    CSR_TIMER_LAP(context, CSR_STAGE_RASTER);
+  }
+}
+
+/* Rasterizes all triangles binned into one tile. Tiles are disjoint so they can run on different threads. */
+CSR_API CSR_INLINE void csr_tiles_raster_job(csr_context *context, int item, int worker)
+{
+  int t = context->bin_cursor[item];
+  int tile_min_x = (t % context->tiles_x) * CSR_TILE_SIZE;
+  int tile_min_y = (t / context->tiles_x) * CSR_TILE_SIZE;
+  int tile_max_x = csr_mini(tile_min_x + CSR_TILE_SIZE, context->width) - 1;
+  int tile_max_y = csr_mini(tile_min_y + CSR_TILE_SIZE, context->height) - 1;
+  unsigned long samples = 0;
+  int e;
+
+#ifdef CSR_ENABLE_TIMINGS
+  unsigned long start = context->timer && context->tile_cycles ? context->timer() : 0;
+#endif
+
+  for (e = context->bin_offsets[t]; e < context->bin_offsets[t + 1]; ++e)
+  {
+    csr_triangle *tri = &context->triangles[context->bin_entries[e]];
+
+    samples += csr_triangle_raster(
+        context, tri,
+        csr_maxi(tri->min_x, tile_min_x), csr_maxi(tri->min_y, tile_min_y),
+        csr_mini(tri->max_x, tile_max_x), csr_mini(tri->max_y, tile_max_y), worker);
+  }
+
+  /* Every worker has its own counter, so tiles on different threads never write the same one */
+  context->query_samples[worker] += samples;
+
+  if (context->hiz)
+  {
+    csr_hiz_update_tile(context, t);
+  }
+
+#ifdef CSR_ENABLE_TIMINGS
+  if (context->timer && context->tile_cycles)
+  {
+    context->tile_cycles[t] += context->timer() - start;
+  }
+#endif
+}
+
+/* Rasterizes all pending binned triangles tile by tile and resets the bins. */
+CSR_API CSR_INLINE void csr_tiles_flush(csr_context *context)
+{
+  int tiles_count = context->tiles_x * context->tiles_y;
+  int active_tiles;
+  int timer_started;
+  unsigned long i;
+  int t;
+
+  if (context->triangles_count == 0)
+  {
+    return;
+  }
+
+  timer_started = CSR_TIMER_START(context);
+
+  /* 1. Count the triangles per tile */
+  for (t = 0; t <= tiles_count; ++t)
+  {
+    context->bin_offsets[t] = 0;
+  }
+
+  for (i = 0; i < context->triangles_count; ++i)
+  {
+    csr_triangle *tri = &context->triangles[i];
+    int tx, ty;
+
+    for (ty = tri->min_y / CSR_TILE_SIZE; ty <= tri->max_y / CSR_TILE_SIZE; ++ty)
+    {
+      for (tx = tri->min_x / CSR_TILE_SIZE; tx <= tri->max_x / CSR_TILE_SIZE; ++tx)
+      {
+        context->bin_offsets[ty * context->tiles_x + tx + 1]++;
+      }
+    }
+  }
+
+  /* 2. Prefix sum to get the start of each tiles triangle list */
+  for (t = 0; t < tiles_count; ++t)
+  {
+    context->bin_offsets[t + 1] += context->bin_offsets[t];
+    context->bin_cursor[t] = context->bin_offsets[t];
+  }
+
+  /* 3. Fill the bins in submission order so that depth ties resolve like immediate rendering */
+  for (i = 0; i < context->triangles_count; ++i)
+  {
+    csr_triangle *tri = &context->triangles[i];
+    int tx, ty;
+
+    for (ty = tri->min_y / CSR_TILE_SIZE; ty <= tri->max_y / CSR_TILE_SIZE; ++ty)
+    {
+      for (tx = tri->min_x / CSR_TILE_SIZE; tx <= tri->max_x / CSR_TILE_SIZE; ++tx)
+      {
+        context->bin_entries[context->bin_cursor[ty * context->tiles_x + tx]++] = (int)i;
+      }
+    }
+  }
+
+  CSR_TIMER_LAP(context, CSR_STAGE_SETUP);
+
+  /* 4. Rasterize the non empty tiles. The bin cursors are reused as the list of tiles to process. */
+  active_tiles = 0;
+
+  for (t = 0; t < tiles_count; ++t)
+  {
+    if (context->bin_offsets[t] != context->bin_offsets[t + 1])
+    {
+      context->bin_cursor[active_tiles++] = t;
+    }
+  }
+
+  csr_parallel_for(context, active_tiles, csr_tiles_raster_job);
+
+  CSR_TIMER_LAP(context, CSR_STAGE_RASTER);
+  CSR_TIMER_STOP(context, timer_started);
+
+  context->triangles_count = 0;
+  context->bin_count = 0;
+}
+
+/* Sets up a triangle and adds it to the tile bins. Without binning memory the triangle is drawn immediately. */
+CSR_API CSR_INLINE void csr_tiles_add_triangle(csr_context *context, float p0[3], float p1[3], float p2[3], csr_color c0, csr_color c1, csr_color c2)
+{
+  csr_triangle *tri;
+  unsigned long tri_tiles;
+
+  if (!context->triangles)
+  {
+    csr_draw_triangle(context, p0, p1, p2, c0, c1, c2);
+    return;
+  }
+
+  if (context->triangles_count == CSR_TRIANGLE_BATCH_SIZE)
+  {
+    csr_tiles_flush(context);
+  }
+
+  tri = &context->triangles[context->triangles_count];
+
+  if (!csr_triangle_setup(context, tri, p0, p1, p2, c0, c1, c2))
+  {
+    return;
+  }
+
+  tri_tiles = (unsigned long)((tri->max_x / CSR_TILE_SIZE - tri->min_x / CSR_TILE_SIZE + 1) *
+                              (tri->max_y / CSR_TILE_SIZE - tri->min_y / CSR_TILE_SIZE + 1));
+
+  if (context->bin_count + tri_tiles > CSR_BIN_ENTRIES_MAX)
+  {
+    csr_triangle copy = *tri;
+
+    csr_tiles_flush(context);
+
+    /* A single triangle touching more tiles than the bins can hold is rasterized directly */
+    if (tri_tiles > CSR_BIN_ENTRIES_MAX)
+    {
+      csr_triangle_raster_all(context, &copy);
+      CSR_TIMER_LAP(context, CSR_STAGE_RASTER);
+      return;
+    }
+
+    context->triangles[0] = copy;
+  }
+
+  context->triangles_count++;
+  context->bin_count += tri_tiles;
+}
+
+/* Returns the colors of the corners of a triangle: the vertex colors of meshes with a stride of 6 (x, y, z, r, g, b),
+ * otherwise red, green and blue.
+ */
+CSR_API CSR_INLINE void csr_triangle_colors(csr_color colors[3], int stride, float *vertices, int i0, int i1, int i2)
+{
+  colors[0] = stride == 3 ? csr_init_color(255, 50, 50) : csr_init_color((unsigned char)vertices[i0 * stride + 3], (unsigned char)vertices[i0 * stride + 4], (unsigned char)vertices[i0 * stride + 5]);
+  colors[1] = stride == 3 ? csr_init_color(50, 255, 50) : csr_init_color((unsigned char)vertices[i1 * stride + 3], (unsigned char)vertices[i1 * stride + 4], (unsigned char)vertices[i1 * stride + 5]);
+  colors[2] = stride == 3 ? csr_init_color(50, 50, 255) : csr_init_color((unsigned char)vertices[i2 * stride + 3], (unsigned char)vertices[i2 * stride + 4], (unsigned char)vertices[i2 * stride + 5]);
+}
+
+/* Culls a projected triangle by its winding order and hands it to the rasterizer (or draws its edges in wireframe mode). */
+CSR_API CSR_INLINE void csr_render_triangle(csr_context *context, csr_render_mode render_mode, csr_culling_mode culling_mode, int stride, float *vertices, int i0, int i1, int i2, float v0_screen[3], float v1_screen[3], float v2_screen[3])
+{
+  CSR_STATS_ADD(&context->stats[0], triangles_submitted, 1);
+
+  /* 4. Culling based on winding order */
+  if (culling_mode != CSR_CULLING_DISABLED)
+  {
+    float ax = v1_screen[0] - v0_screen[0];
+    float ay = v1_screen[1] - v0_screen[1];
+    float bx = v2_screen[0] - v0_screen[0];
+    float by = v2_screen[1] - v0_screen[1];
+    float face = ax * by - ay * bx;
+
+    int is_ccw_face = (face >= 0.0f);
+    int is_cw_face = (face <= 0.0f);
+
+    int should_cull = 0;
+
+    should_cull |= (culling_mode == CSR_CULLING_CCW_BACKFACE) & is_cw_face;
+    should_cull |= (culling_mode == CSR_CULLING_CCW_FRONTFACE) & is_ccw_face;
+    should_cull |= (culling_mode == CSR_CULLING_CW_BACKFACE) & is_ccw_face;
+    should_cull |= (culling_mode == CSR_CULLING_CW_FRONTFACE) & is_cw_face;
+
+    if (should_cull)
+    {
+      CSR_STATS_ADD(&context->stats[0], triangles_culled, 1);
+      return;
+    }
+  }
+
+  /* 5. Rasterization & Depth Testing */
+  if (render_mode != CSR_RENDER_WIREFRAME)
+  {
+    csr_color colors[3];
+
+    CSR_TIMER_LAP(context, CSR_STAGE_CULL);
+    csr_triangle_colors(colors, stride, vertices, i0, i1, i2);
+    csr_tiles_add_triangle(context, v0_screen, v1_screen, v2_screen, colors[0], colors[1], colors[2]);
+    CSR_TIMER_LAP(context, CSR_STAGE_SETUP);
+  }
+  else
+  {
+    csr_color color0 = stride == 3 ? csr_init_color(255, 50, 50) : csr_init_color((unsigned char)vertices[i0 * stride + 3], (unsigned char)vertices[i0 * stride + 4], (unsigned char)vertices[i0 * stride + 5]);
+
+    CSR_TIMER_LAP(context, CSR_STAGE_CULL);
+    csr_draw_line(context, v0_screen, v1_screen, color0);
+    csr_draw_line(context, v1_screen, v2_screen, color0);
+    csr_draw_line(context, v2_screen, v0_screen, color0);
+    CSR_TIMER_LAP(context, CSR_STAGE_LINES);
+  }
+}
+
+/* Transforms the first count vertices of a mesh into the vertex cache. Every vertex goes through the transform
+ * kernel, the perspective divide and the viewport transform once no matter how many triangles share it.
+ */
+CSR_API CSR_INLINE void csr_vertex_cache_fill(csr_context *context, int stride, float *vertices, unsigned long count, float projection_view_model_matrix[16])
+{
+  float positions[3][CSR_VERTEX_BATCH_SIZE];
+  float clip[4][CSR_VERTEX_BATCH_SIZE];
+  float *positions_ptr[3];
+  float *clip_ptr[4];
+  float *cache_x = context->vertex_cache;
+  float *cache_y = cache_x + CSR_VERTICES_MAX;
+  float *cache_z = cache_y + CSR_VERTICES_MAX;
+  float *cache_w = cache_z + CSR_VERTICES_MAX;
+  unsigned long batch, v;
+  int k;
+
+  positions_ptr[0] = positions[0];
+  positions_ptr[1] = positions[1];
+  positions_ptr[2] = positions[2];
+  clip_ptr[0] = clip[0];
+  clip_ptr[1] = clip[1];
+  clip_ptr[2] = clip[2];
+  clip_ptr[3] = clip[3];
+
+  for (batch = 0; batch < count; batch += CSR_VERTEX_BATCH_SIZE)
+  {
+    int batch_count = (int)(count - batch < CSR_VERTEX_BATCH_SIZE ? count - batch : CSR_VERTEX_BATCH_SIZE);
+
+    /* 1. Vertex Processing (Model, View, Projection) of a batch of consecutive vertices */
+    for (k = 0; k < batch_count; ++k)
+    {
+      float *vertex = &vertices[(batch + (unsigned long)k) * (unsigned long)stride];
+
+      positions[0][k] = vertex[0];
+      positions[1][k] = vertex[1];
+      positions[2][k] = vertex[2];
+    }
+
+    context->kernels.transform(projection_view_model_matrix, positions_ptr, clip_ptr, batch_count);
+
+    for (k = 0; k < batch_count; ++k)
+    {
+      float transformed[4];
+      float ndc[4];
+      float screen[3];
+
+      v = batch + (unsigned long)k;
+      cache_w[v] = clip[3][k];
+
+      /* Vertices behind the camera are never projected, triangles using them are skipped */
+      if (clip[3][k] <= 0.0f)
+      {
+        continue;
+      }
+
+      csr_pos_init(transformed, clip[0][k], clip[1][k], clip[2][k], clip[3][k]);
+
+      /* 2. Perspective Divide (Clip Space to NDC) */
+      csr_v4_divf(ndc, transformed, transformed[3]);
+
+      /* 3. Viewport Transform (NDC to Screen Space) */
+      csr_ndc_to_screen(context, screen, ndc);
+
+      cache_x[v] = screen[0];
+      cache_y[v] = screen[1];
+      cache_z[v] = screen[2];
+    }
+  }
+}
+
+/* Computes the model space bounding box of a mesh, bounds holds the min. x, y, z followed by the max. x, y, z. */
+CSR_API CSR_INLINE void csr_mesh_bounds(float bounds[6], int stride, float *vertices, unsigned long num_vertices)
+{
+  unsigned long i;
+  int k;
+
+  for (k = 0; k < 3; ++k)
+  {
+    bounds[k] = num_vertices >= 3 ? vertices[k] : 0.0f;
+    bounds[k + 3] = bounds[k];
+  }
+
+  for (i = 0; i + 2 < num_vertices; i += (unsigned long)stride)
+  {
+    for (k = 0; k < 3; ++k)
+    {
+      bounds[k] = csr_minf(bounds[k], vertices[i + (unsigned long)k]);
+      bounds[k + 3] = csr_maxf(bounds[k + 3], vertices[i + (unsigned long)k]);
+    }
+  }
+}
+
+/* Classifies a model space bounding box against the clip space frustum of the matrix by its eight corners.
+ * Boxes entirely on the outer side of the left, right, top, bottom or far plane or behind the camera are outside.
+ * Boxes in front of the camera whose projection stays two pixels away from the screen border are inside, which
+ * leaves room for the approximate perspective divide.
+ */
+CSR_API CSR_INLINE csr_frustum_result csr_frustum_classify(csr_context *context, float projection_view_model_matrix[16], float bounds[6])
+{
+  float scale_x = 1.0f - 4.0f / (float)context->width;
+  float scale_y = 1.0f - 4.0f / (float)context->height;
+  int outside[6] = {1, 1, 1, 1, 1, 1}; /* every corner is on the outer side of left, right, bottom, top, far, camera */
+  int inside = 1;
+  int corner;
+
+  for (corner = 0; corner < 8; ++corner)
+  {
+    float position[4];
+    float clip[4];
+
+    csr_pos_init(position, bounds[(corner & 1) ? 3 : 0], bounds[(corner & 2) ? 4 : 1], bounds[(corner & 4) ? 5 : 2], 1.0f);
+    csr_m4x4_mul_v4(clip, projection_view_model_matrix, position);
+
+    outside[0] &= clip[0] < -clip[3];
+    outside[1] &= clip[0] > clip[3];
+    outside[2] &= clip[1] < -clip[3];
+    outside[3] &= clip[1] > clip[3];
+    outside[4] &= clip[2] > clip[3];
+    outside[5] &= clip[3] <= 0.0f;
+
+    inside &= clip[3] > 0.0f && csr_absf(clip[0]) <= clip[3] * scale_x && csr_absf(clip[1]) <= clip[3] * scale_y;
+  }
+
+  if (outside[0] | outside[1] | outside[2] | outside[3] | outside[4] | outside[5])
+  {
+    return CSR_FRUSTUM_OUTSIDE;
+  }
+
+  return inside ? CSR_FRUSTUM_INSIDE : CSR_FRUSTUM_INTERSECTS;
+}
+
+/* Returns 0 if nothing inside of the model space box can pass the depth test of the current zbuffer, e.g. because
+ * the box is hidden behind occluders rendered before. The screen rectangle of the box (widened by a pixel) is
+ * tested at its nearest depth against the max. depth of the blocks it touches. Triangles still waiting in the
+ * bins (csr_render_instanced, csr_execute) are not considered yet. Boxes crossing the camera plane and contexts
+ * without hierarchical depth (no binning memory) always count as visible.
+ */
+CSR_API CSR_INLINE int csr_occlusion_test_aabb(csr_context *context, float projection_view_model_matrix[16], float box_min[3], float box_max[3])
+{
+  float screen_min_x = CSR_DEPTH_UNKNOWN, screen_min_y = CSR_DEPTH_UNKNOWN, z_near = CSR_DEPTH_UNKNOWN;
+  float screen_max_x = -CSR_DEPTH_UNKNOWN, screen_max_y = -CSR_DEPTH_UNKNOWN;
+  int min_x, min_y, max_x, max_y;
+  int tile_x, tile_y;
+  int corner;
+
+  if (!context->hiz)
+  {
+    return 1;
+  }
+
+  for (corner = 0; corner < 8; ++corner)
+  {
+    float position[4];
+    float clip[4];
+    float ndc[4];
+    float screen[3];
+
+    csr_pos_init(position, (corner & 1) ? box_max[0] : box_min[0], (corner & 2) ? box_max[1] : box_min[1], (corner & 4) ? box_max[2] : box_min[2], 1.0f);
+    csr_m4x4_mul_v4(clip, projection_view_model_matrix, position);
+
+    if (clip[3] <= 0.0f)
+    {
+      return 1;
+    }
+
+    csr_v4_divf(ndc, clip, clip[3]);
+    csr_ndc_to_screen(context, screen, ndc);
+
+    screen_min_x = csr_minf(screen_min_x, screen[0]);
+    screen_min_y = csr_minf(screen_min_y, screen[1]);
+    screen_max_x = csr_maxf(screen_max_x, screen[0]);
+    screen_max_y = csr_maxf(screen_max_y, screen[1]);
+    z_near = csr_minf(z_near, screen[2]);
+  }
+
+  /* Pixels whose centers are inside of the rectangle widened by a pixel for the approximate perspective divide,
+   * clamped to [-1, size] first so that the truncating conversions round down.
+   */
+  min_x = (int)(csr_minf(csr_maxf(screen_min_x - 1.5f, -1.0f), (float)context->width) + 1.0f);
+  min_y = (int)(csr_minf(csr_maxf(screen_min_y - 1.5f, -1.0f), (float)context->height) + 1.0f);
+  max_x = csr_mini((int)(csr_minf(csr_maxf(screen_max_x + 0.5f, -1.0f), (float)context->width) + 1.0f) - 1, context->width - 1);
+  max_y = csr_mini((int)(csr_minf(csr_maxf(screen_max_y + 0.5f, -1.0f), (float)context->height) + 1.0f) - 1, context->height - 1);
+
+  if (min_x > max_x || min_y > max_y)
+  {
+    return 0;
+  }
+
+  z_near -= CSR_OCCLUSION_TOLERANCE * (1.0f + csr_absf(z_near));
+
+  for (tile_y = min_y / CSR_TILE_SIZE; tile_y <= max_y / CSR_TILE_SIZE; ++tile_y)
+  {
+    for (tile_x = min_x / CSR_TILE_SIZE; tile_x <= max_x / CSR_TILE_SIZE; ++tile_x)
+    {
+      int tile = tile_y * context->tiles_x + tile_x;
+
+      /* Usually a no-op, the tiles are updated when their bins are flushed */
+      csr_hiz_update_tile(context, tile);
+
+      if (z_near >= context->hiz_tiles[tile])
+      {
+        continue;
+      }
+
+      if (csr_hiz_test_rect(
+              context, tile,
+              csr_maxi(min_x, tile_x * CSR_TILE_SIZE), csr_maxi(min_y, tile_y * CSR_TILE_SIZE),
+              csr_mini(max_x, tile_x * CSR_TILE_SIZE + CSR_TILE_SIZE - 1), csr_mini(max_y, tile_y * CSR_TILE_SIZE + CSR_TILE_SIZE - 1),
+              z_near, 0))
+      {
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/* Transforms and culls indexed triangles and adds them to the tile bins (or draws them immediately without
+ * binning memory). Meshes with up to CSR_VERTICES_MAX vertices are transformed once per vertex into the vertex
+ * cache, larger ones once per index. Meshes whose bounding box (see csr_mesh_bounds) is outside the frustum are
+ * skipped before any vertex is transformed, meshes inside skip the camera plane and screen border checks.
+ */
+CSR_API CSR_INLINE void csr_render_mesh(csr_context *context, csr_render_mode render_mode, csr_culling_mode culling_mode, int stride, float *vertices, unsigned long num_vertices, int *indices, unsigned long num_indices, float projection_view_model_matrix[16], float bounds[6])
+{
+  float positions[3][CSR_VERTEX_BATCH_SIZE];
+  float clip[4][CSR_VERTEX_BATCH_SIZE];
+  float *positions_ptr[3];
+  float *clip_ptr[4];
+  unsigned long vertex_count = num_vertices / (unsigned long)stride;
+  unsigned long batch, i;
+  int timer_started = CSR_TIMER_START(context);
+  int inside;
+  int k;
+
+  CSR_STATS_ADD(&context->stats[0], meshes_submitted, 1);
+
+  switch (csr_frustum_classify(context, projection_view_model_matrix, bounds))
+  {
+  case CSR_FRUSTUM_OUTSIDE:
+    CSR_STATS_ADD(&context->stats[0], meshes_culled, 1);
+    CSR_TIMER_LAP(context, CSR_STAGE_CULL);
+    CSR_TIMER_STOP(context, timer_started);
+    return;
+  case CSR_FRUSTUM_INSIDE:
+    inside = 1;
+    break;
+  default:
+    inside = 0;
+    break;
+  }
+
+  context->mesh_inside = inside;
+
+  if (context->vertex_cache && vertex_count <= CSR_VERTICES_MAX)
+  {
+    float *cache_x = context->vertex_cache;
+    float *cache_y = cache_x + CSR_VERTICES_MAX;
+    float *cache_z = cache_y + CSR_VERTICES_MAX;
+    float *cache_w = cache_z + CSR_VERTICES_MAX;
+
+    CSR_TIMER_LAP(context, CSR_STAGE_CULL);
+    csr_vertex_cache_fill(context, stride, vertices, vertex_count, projection_view_model_matrix);
+    CSR_TIMER_LAP(context, CSR_STAGE_TRANSFORM);
+
+    for (i = 0; i + 2 < num_indices; i += 3)
+    {
+      int i0 = indices[i];
+      int i1 = indices[i + 1];
+      int i2 = indices[i + 2];
+
+      float v0_screen[3];
+      float v1_screen[3];
+      float v2_screen[3];
+
+      /* Check if the triangle is behind the camera (clipping) */
+      if (!inside && (cache_w[i0] <= 0.0f || cache_w[i1] <= 0.0f || cache_w[i2] <= 0.0f))
+      {
+        CSR_STATS_ADD(&context->stats[0], triangles_submitted, 1);
+        CSR_STATS_ADD(&context->stats[0], triangles_w_rejected, 1);
+        continue;
+      }
+
+      v0_screen[0] = cache_x[i0], v0_screen[1] = cache_y[i0], v0_screen[2] = cache_z[i0];
+      v1_screen[0] = cache_x[i1], v1_screen[1] = cache_y[i1], v1_screen[2] = cache_z[i1];
+      v2_screen[0] = cache_x[i2], v2_screen[1] = cache_y[i2], v2_screen[2] = cache_z[i2];
+
+      context->visibility_id = context->visibility_draw | (unsigned int)(i / 3);
+      csr_render_triangle(context, render_mode, culling_mode, stride, vertices, i0, i1, i2, v0_screen, v1_screen, v2_screen);
+    }
+
+  }
+  else
+  {
+    /* Meshes not fitting into the vertex cache are transformed once per index */
+    positions_ptr[0] = positions[0];
+    positions_ptr[1] = positions[1];
+    positions_ptr[2] = positions[2];
+    clip_ptr[0] = clip[0];
+    clip_ptr[1] = clip[1];
+    clip_ptr[2] = clip[2];
+    clip_ptr[3] = clip[3];
+
+    for (batch = 0; batch < num_indices; batch += CSR_VERTEX_BATCH_SIZE)
+    {
+      int count = (int)(num_indices - batch < CSR_VERTEX_BATCH_SIZE ? num_indices - batch : CSR_VERTEX_BATCH_SIZE);
+
+      CSR_TIMER_LAP(context, CSR_STAGE_CULL);
+
+      /* 1. Vertex Processing (Model, View, Projection) of a batch of indexed vertices */
+      for (k = 0; k < count; ++k)
+      {
+        int index = indices[batch + (unsigned long)k];
+
+        positions[0][k] = vertices[index * stride + 0];
+        positions[1][k] = vertices[index * stride + 1];
+        positions[2][k] = vertices[index * stride + 2];
+      }
+
+      context->kernels.transform(projection_view_model_matrix, positions_ptr, clip_ptr, count);
+
+      CSR_TIMER_LAP(context, CSR_STAGE_TRANSFORM);
+
+      for (k = 0; k + 2 < count; k += 3)
+      {
+        /* Clip space positions computed by the transform kernel */
+        float v0_transformed[4];
+        float v1_transformed[4];
+        float v2_transformed[4];
+
+        float v0_ndc[4];
+        float v1_ndc[4];
+        float v2_ndc[4];
+
+        float v0_screen[3];
+        float v1_screen[3];
+        float v2_screen[3];
+
+        i = batch + (unsigned long)k;
+
+        csr_pos_init(v0_transformed, clip[0][k], clip[1][k], clip[2][k], clip[3][k]);
+        csr_pos_init(v1_transformed, clip[0][k + 1], clip[1][k + 1], clip[2][k + 1], clip[3][k + 1]);
+        csr_pos_init(v2_transformed, clip[0][k + 2], clip[1][k + 2], clip[2][k + 2], clip[3][k + 2]);
+
+        /* Check if the triangle is behind the camera (clipping) */
+        if (!inside && (v0_transformed[3] <= 0.0f || v1_transformed[3] <= 0.0f || v2_transformed[3] <= 0.0f))
+        {
+          CSR_STATS_ADD(&context->stats[0], triangles_submitted, 1);
+          CSR_STATS_ADD(&context->stats[0], triangles_w_rejected, 1);
+          continue;
+        }
+
+        /* 2. Perspective Divide (Clip Space to NDC) */
+        csr_v4_divf(v0_ndc, v0_transformed, v0_transformed[3]);
+        csr_v4_divf(v1_ndc, v1_transformed, v1_transformed[3]);
+        csr_v4_divf(v2_ndc, v2_transformed, v2_transformed[3]);
+
+        /* 3. Viewport Transform (NDC to Screen Space) */
+        csr_ndc_to_screen(context, v0_screen, v0_ndc);
+        csr_ndc_to_screen(context, v1_screen, v1_ndc);
+        csr_ndc_to_screen(context, v2_screen, v2_ndc);
+
+        context->visibility_id = context->visibility_draw | (unsigned int)(i / 3);
+        csr_render_triangle(context, render_mode, culling_mode, stride, vertices, indices[i], indices[i + 1], indices[i + 2], v0_screen, v1_screen, v2_screen);
+      }
+    }
+  }
+
+  CSR_TIMER_LAP(context, CSR_STAGE_CULL);
+  CSR_TIMER_STOP(context, timer_started);
+
+  context->mesh_inside = 0;
+}
+
+/* Transforms, culls and rasterizes indexed triangles. num_vertices is the number of floats in vertices.
+ *
+ * For a depth prepass render the opaque scene with CSR_RENDER_DEPTH_ONLY and then again with
+ * CSR_RENDER_DEPTH_EQUAL (same vertices and matrices), so the colors of every pixel are computed and stored
+ * once instead of once per overlapping triangle. Pixels where triangles have exactly the same depth get the
+ * color of the last of them instead of the first.
+ */
+CSR_API CSR_INLINE void csr_render(csr_context *context, csr_render_mode render_mode, csr_culling_mode culling_mode, int stride, float *vertices, unsigned long num_vertices, int *indices, unsigned long num_indices, float projection_view_model_matrix[16])
+{
+  float bounds[6];
+
+  csr_mesh_bounds(bounds, stride, vertices, num_vertices);
+
+  context->mode = render_mode;
+
+  csr_render_mesh(context, render_mode, culling_mode, stride, vertices, num_vertices, indices, num_indices, projection_view_model_matrix, bounds);
+
+  /* 6. Rasterize the binned triangles tile by tile */
+  csr_tiles_flush(context);
+
+  context->mode = CSR_RENDER_SOLID;
+}
+
+/* Same as csr_render with the model space bounding box of the mesh computed once by csr_mesh_bounds
+ * (or any box containing all vertices) instead of on every call. Triangles outside of a box that does not
+ * contain all vertices may be dropped or drawn wrong, but are never drawn outside of the screen.
+ */
+CSR_API CSR_INLINE void csr_render_bounded(csr_context *context, csr_render_mode render_mode, csr_culling_mode culling_mode, int stride, float *vertices, unsigned long num_vertices, int *indices, unsigned long num_indices, float projection_view_model_matrix[16], float bounds[6])
+{
+  context->mode = render_mode;
+
+  csr_render_mesh(context, render_mode, culling_mode, stride, vertices, num_vertices, indices, num_indices, projection_view_model_matrix, bounds);
+
+  /* Rasterize the binned triangles tile by tile */
+  csr_tiles_flush(context);
+
+  context->mode = CSR_RENDER_SOLID;
+}
+
+/* Renders instance_count copies of a mesh, matrices holds one projection view model matrix (16 floats) per
+ * instance. The result is the same as calling csr_render for every instance in order, but the triangles of
+ * all instances share the tile bins, so tiles are rasterized once per batch instead of once per instance.
+ */
+CSR_API CSR_INLINE void csr_render_instanced(csr_context *context, csr_render_mode render_mode, csr_culling_mode culling_mode, int stride, float *vertices, unsigned long num_vertices, int *indices, unsigned long num_indices, float *matrices, unsigned long instance_count)
+{
+  unsigned long instance;
+  float bounds[6];
+
+  csr_mesh_bounds(bounds, stride, vertices, num_vertices);
+
+  context->mode = render_mode;
+
+  for (instance = 0; instance < instance_count; ++instance)
+  {
+    csr_render_mesh(context, render_mode, culling_mode, stride, vertices, num_vertices, indices, num_indices, &matrices[instance * 16], bounds);
+  }
+
+  /* Rasterize the binned triangles of all instances tile by tile */
+  csr_tiles_flush(context);
+
+  context->mode = CSR_RENDER_SOLID;
+}
+
+/* Starts counting the pixels that pass the depth test (samples) of all triangles and lines rendered until
+ * csr_occlusion_query_end. Triangles still waiting in the bins are rasterized first and not counted.
+ */
+CSR_API CSR_INLINE void csr_occlusion_query_begin(csr_context *context)
+{
+  int i;
+
+  csr_tiles_flush(context);
+
+  for (i = 0; i < CSR_WORKERS_MAX; ++i)
+  {
+    context->query_samples[i] = 0;
+  }
+
+  context->query_active = 1;
+}
+
+/* Stops the occlusion query and returns the number of samples that passed the depth test, 0 if everything
+ * rendered since csr_occlusion_query_begin was hidden. Pixels are counted once per triangle or line that
+ * passed the depth test there, so overlapping geometry counts a pixel more than once.
+ */
+CSR_API CSR_INLINE unsigned long csr_occlusion_query_end(csr_context *context)
+{
+  unsigned long samples = 0;
+  int i;
+
+  csr_tiles_flush(context);
+
+  context->query_active = 0;
+
+  for (i = 0; i < CSR_WORKERS_MAX; ++i)
+  {
+    samples += context->query_samples[i];
+  }
+
+  return samples;
+}
+
+/* Starts collecting debug output of everything rendered until csr_debug_end. overdraw (width * height entries)
+ * counts per pixel how often a triangle, line or voxel ray pixel was depth tested, including pixels rejected by
+ * the hierarchical depth. tile_cycles (tiles_x * tiles_y entries) sums the cycles spent rasterizing each tile of
+ * the tile binning, it needs CSR_ENABLE_TIMINGS and csr_context.timer. Either may be 0.
+ */
+CSR_API CSR_INLINE void csr_debug_begin(csr_context *context, unsigned int *overdraw, unsigned long *tile_cycles)
+{
+  int i;
+
+  csr_tiles_flush(context);
+
+  for (i = 0; overdraw && i < context->width * context->height; ++i)
+  {
+    overdraw[i] = 0;
+  }
+
+  for (i = 0; tile_cycles && i < context->tiles_x * context->tiles_y; ++i)
+  {
+    tile_cycles[i] = 0;
+  }
+
+  context->overdraw = overdraw;
+  context->tile_cycles = tile_cycles;
+}
+
+/* Rasterizes the pending triangles and stops collecting debug output. */
+CSR_API CSR_INLINE void csr_debug_end(csr_context *context)
+{
+  csr_tiles_flush(context);
+
+  context->overdraw = 0;
+  context->tile_cycles = 0;
+}
+
+/* Maps value / max to a false color from blue over cyan, green and yellow to red. 0 is black. */
+CSR_API CSR_INLINE csr_color csr_heatmap_color(unsigned long value, unsigned long max)
+{
+  unsigned long scaled;
+  unsigned char ramp;
+
+  if (value == 0 || max == 0)
+  {
+    return csr_init_color(0, 0, 0);
+  }
+
+  /* Position on the 4 segments of the ramp in 1 / 256 steps */
+  scaled = (value >= max) ? 1023 : (value * 1023) / max;
+  ramp = (unsigned char)(scaled & 255);
+
+  switch (scaled >> 8)
+  {
+  case 0:
+    return csr_init_color(0, ramp, 255);
+  case 1:
+    return csr_init_color(0, 255, (unsigned char)(255 - ramp));
+  case 2:
+    return csr_init_color(ramp, 255, 0);
+  default:
+    return csr_init_color(255, (unsigned char)(255 - ramp), 0);
+  }
+}
+
+/* Writes the overdraw counts of csr_debug_begin as a false color image of width * height pixels, black pixels
+ * were never tested and red ones CSR_OVERDRAW_HEATMAP_MAX times or more.
+ */
+CSR_API CSR_INLINE void csr_heatmap_overdraw(csr_context *context, csr_color *image, unsigned int *overdraw)
+{
+  int i;
+
+  for (i = 0; i < context->width * context->height; ++i)
+  {
+    image[i] = csr_heatmap_color(overdraw[i], CSR_OVERDRAW_HEATMAP_MAX);
+  }
+}
+
+/* Writes the tile cycles of csr_debug_begin as a false color image of width * height pixels relative to the most
+ * expensive tile, which is red.
+ */
+CSR_API CSR_INLINE void csr_heatmap_tile_cycles(csr_context *context, csr_color *image, unsigned long *tile_cycles)
+{
+  unsigned long max = 0;
+  int i, x, y;
+
+  for (i = 0; i < context->tiles_x * context->tiles_y; ++i)
+  {
+    max = tile_cycles[i] > max ? tile_cycles[i] : max;
+  }
+
+  for (y = 0; y < context->height; ++y)
+  {
+    for (x = 0; x < context->width; ++x)
+    {
+      image[y * context->width + x] = csr_heatmap_color(tile_cycles[(y / CSR_TILE_SIZE) * context->tiles_x + x / CSR_TILE_SIZE], max);
+    }
+  }
+}
+
+/* Returns the memory size of a command buffer holding up to capacity draws. */
+CSR_API CSR_INLINE unsigned long csr_command_buffer_memory_size(unsigned long capacity)
+{
+  return csr_memory_align(capacity * (unsigned long)sizeof(csr_draw_command)) + /* commands */
+         csr_memory_align(capacity * (unsigned long)sizeof(unsigned long));     /* order    */
+}
+
+/* Sets up an empty command buffer in the given memory. Returns 0 if not even a single draw fits. */
+CSR_API CSR_INLINE int csr_command_buffer_init(csr_command_buffer *buffer, void *memory, unsigned long memory_size)
+{
+  unsigned long capacity = memory_size / ((unsigned long)sizeof(csr_draw_command) + (unsigned long)sizeof(unsigned long));
+
+  /* Shrink the capacity until the aligned arrays fit */
+  while (capacity > 0 && csr_command_buffer_memory_size(capacity) > memory_size)
+  {
+    --capacity;
+  }
+
+  if (capacity == 0)
+  {
+    return 0;
+  }
+
+  buffer->commands = (csr_draw_command *)memory;
+  buffer->order = (unsigned long *)((char *)memory + csr_memory_align(capacity * (unsigned long)sizeof(csr_draw_command)));
+  buffer->count = 0;
+  buffer->capacity = capacity;
+
+  return 1;
+}
+
+/* Removes all recorded draws, e.g. at the start of a frame. */
+CSR_API CSR_INLINE void csr_command_buffer_reset(csr_command_buffer *buffer)
+{
+  buffer->count = 0;
+}
+
+/* Records a draw with the arguments of csr_render. The vertices and indices are referenced, not copied, and
+ * must stay valid until csr_execute. Returns 0 if the buffer is full.
+ */
+CSR_API CSR_INLINE int csr_record_render(csr_command_buffer *buffer, csr_render_mode render_mode, csr_culling_mode culling_mode, int stride, float *vertices, unsigned long num_vertices, int *indices, unsigned long num_indices, float projection_view_model_matrix[16])
+{
+  csr_draw_command *command;
+  float center[3];
+  int i;
+
+  if (buffer->count == buffer->capacity)
+  {
+    return 0;
+  }
+
+  command = &buffer->commands[buffer->count++];
+  command->render_mode = render_mode;
+  command->culling_mode = culling_mode;
+  command->stride = stride;
+  command->vertices = vertices;
+  command->num_vertices = num_vertices;
+  command->indices = indices;
+  command->num_indices = num_indices;
+
+  for (i = 0; i < 16; ++i)
+  {
+    command->matrix[i] = projection_view_model_matrix[i];
+  }
+
+  csr_mesh_bounds(command->bounds, stride, vertices, num_vertices);
+
+  for (i = 0; i < 3; ++i)
+  {
+    center[i] = (command->bounds[i] + command->bounds[i + 3]) * 0.5f;
+  }
+
+  /* Clip z is an affine function of the view space depth for perspective and orthographic projections. The box
+   * center instead of the model origin also sorts meshes whose vertices are already in world space.
+   */
+  command->depth = projection_view_model_matrix[CSR_M4X4_AT(2, 0)] * center[0] +
+                   projection_view_model_matrix[CSR_M4X4_AT(2, 1)] * center[1] +
+                   projection_view_model_matrix[CSR_M4X4_AT(2, 2)] * center[2] +
+                   projection_view_model_matrix[CSR_M4X4_AT(2, 3)];
+
+  return 1;
+}
+
+/* Returns 1 if recorded draw a has to be executed before draw b. Depth only draws come first and depth equal
+ * draws last, so a depth prepass recorded in any order still works. Within a pass draws run front to back
+ * and draws at the same depth in recording order.
+ */
+CSR_API CSR_INLINE int csr_command_before(csr_command_buffer *buffer, unsigned long a, unsigned long b)
+{
+  csr_draw_command *command_a = &buffer->commands[a];
+  csr_draw_command *command_b = &buffer->commands[b];
+  int pass_a = command_a->render_mode == CSR_RENDER_DEPTH_ONLY ? 0 : (command_a->render_mode == CSR_RENDER_DEPTH_EQUAL ? 2 : 1);
+  int pass_b = command_b->render_mode == CSR_RENDER_DEPTH_ONLY ? 0 : (command_b->render_mode == CSR_RENDER_DEPTH_EQUAL ? 2 : 1);
+
+  if (pass_a != pass_b)
+  {
+    return pass_a < pass_b;
+  }
+
+  if (command_a->depth != command_b->depth)
+  {
+    return command_a->depth < command_b->depth;
+  }
+
+  return a < b;
+}
+
+/* Moves order[root] down the max heap order[0..end) until both children execute before it. */
+CSR_API CSR_INLINE void csr_command_sift_down(csr_command_buffer *buffer, unsigned long root, unsigned long end)
+{
+  unsigned long *order = buffer->order;
+
+  for (;;)
+  {
+    unsigned long child = root * 2 + 1;
+    unsigned long t;
+
+    if (child >= end)
+    {
+      break;
+    }
+
+    if (child + 1 < end && csr_command_before(buffer, order[child], order[child + 1]))
+    {
+      ++child;
+    }
+
+    if (!csr_command_before(buffer, order[root], order[child]))
+    {
+      break;
+    }
+
+    t = order[root];
+    order[root] = order[child];
+    order[child] = t;
+    root = child;
+  }
+}
+
+/* Computes the execution order of the recorded draws (heap sort, no extra memory). */
+CSR_API CSR_INLINE void csr_command_buffer_sort(csr_command_buffer *buffer)
+{
+  unsigned long *order = buffer->order;
+  unsigned long count = buffer->count;
+  unsigned long i;
+
+  for (i = 0; i < count; ++i)
+  {
+    order[i] = i;
+  }
+
+  /* Build a max heap, then move the last draw to the end of the order one at a time */
+  for (i = count / 2; i > 0; --i)
+  {
+    csr_command_sift_down(buffer, i - 1, count);
+  }
+
+  for (i = count; i > 1; --i)
+  {
+    unsigned long t = order[0];
+    order[0] = order[i - 1];
+    order[i - 1] = t;
+
+    csr_command_sift_down(buffer, 0, i - 1);
+  }
+}
+
+/* Sorts the recorded draws (heap sort, no extra memory) and renders them. Consecutive draws with the same render
+ * mode share the tile bins like instanced draws, so tiles are rasterized once per batch instead of once per draw.
+ * Opaque draws run front to back, so hidden triangles are mostly rejected by the depth test before their colors
+ * are computed. The buffer is left unchanged and can be executed again.
+ */
+CSR_API CSR_INLINE void csr_execute(csr_context *context, csr_command_buffer *buffer)
+{
+  unsigned long i;
+
+  csr_command_buffer_sort(buffer);
+
+  context->mode = CSR_RENDER_SOLID;
+
+  for (i = 0; i < buffer->count; ++i)
+  {
+    csr_draw_command *command = &buffer->commands[buffer->order[i]];
+
+    /* The render mode is applied when the bins are rasterized */
+    if (command->render_mode != context->mode)
+    {
+      csr_tiles_flush(context);
+      context->mode = command->render_mode;
+    }
+
+    context->visibility_draw = (unsigned int)buffer->order[i] << CSR_VISIBILITY_TRIANGLE_BITS;
+
+    csr_render_mesh(context, command->render_mode, command->culling_mode, command->stride, command->vertices, command->num_vertices, command->indices, command->num_indices, command->matrix, command->bounds);
+  }
+
+  csr_tiles_flush(context);
+
+  context->mode = CSR_RENDER_SOLID;
+  context->visibility_draw = 0;
+}
+
+/* Triangle of a visibility buffer id reconstructed by the resolve pass */
+typedef struct csr_visibility_triangle
+{
+  unsigned int id;
+  float b1, b1_dx, b1_dy; /* barycentric weights of vertex 1 and 2 at pixel (0, 0) and their gradients */
+  float b2, b2_dx, b2_dy;
+  float color[3][3];      /* r, g, b of vertex 0 and the differences of vertex 1 and 2 to it           */
+
+} csr_visibility_triangle;
+
+/* Projects the triangle of a visibility buffer id again (snapped like the rasterizer) and sets up the planes
+ * of its screen space barycentric weights.
+ */
+CSR_API CSR_INLINE void csr_visibility_triangle_setup(csr_context *context, csr_visibility_triangle *tri, unsigned int id)
+{
+  csr_draw_command *command = &context->visibility_draws->commands[id >> CSR_VISIBILITY_TRIANGLE_BITS];
+  int *triangle = &command->indices[(id & ((1U << CSR_VISIBILITY_TRIANGLE_BITS) - 1)) * 3];
+  csr_color colors[3];
+  float x[3], y[3];
+  float area;
+  int k;
+
+  for (k = 0; k < 3; ++k)
+  {
+    float position[4], clip[4], ndc[4], screen[3];
+    float *vertex = &command->vertices[triangle[k] * command->stride];
+
+    csr_pos_init(position, vertex[0], vertex[1], vertex[2], 1.0f);
+    csr_m4x4_mul_v4(clip, command->matrix, position);
+    csr_v4_divf(ndc, clip, clip[3]);
+    csr_ndc_to_screen(context, screen, ndc);
+
+    x[k] = (float)csr_fixed(screen[0]) / (float)CSR_SUBPIXEL_STEPS;
+    y[k] = (float)csr_fixed(screen[1]) / (float)CSR_SUBPIXEL_STEPS;
+  }
+
+  area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+  area = area != 0.0f ? area : 1.0f;
+
+  /* b1 and b2 are the edge functions of the edges opposite to vertex 1 and 2 divided by the area */
+  tri->b1_dx = (y[2] - y[0]) / area;
+  tri->b1_dy = (x[0] - x[2]) / area;
+  tri->b1 = -(x[0] * tri->b1_dx + y[0] * tri->b1_dy);
+  tri->b2_dx = (y[0] - y[1]) / area;
+  tri->b2_dy = (x[1] - x[0]) / area;
+  tri->b2 = -(x[0] * tri->b2_dx + y[0] * tri->b2_dy);
+
+  csr_triangle_colors(colors, command->stride, command->vertices, triangle[0], triangle[1], triangle[2]);
+
+  for (k = 0; k < 3; ++k)
+  {
+    tri->color[0][k] = (float)(k == 0 ? colors[0].r : k == 1 ? colors[0].g : colors[0].b);
+    tri->color[1][k] = (float)(k == 0 ? colors[1].r : k == 1 ? colors[1].g : colors[1].b) - tri->color[0][k];
+    tri->color[2][k] = (float)(k == 0 ? colors[2].r : k == 1 ? colors[2].g : colors[2].b) - tri->color[0][k];
+  }
+
+  tri->id = id;
+}
+
+/* Shades the visible pixels of a row once each: vertex colors interpolated with the barycentric weights at the
+ * pixel center. Pixels without an id (cleared, drawn by lines or before the visibility pass) are kept.
+ */
+CSR_API CSR_INLINE void csr_visibility_resolve_job(csr_context *context, int item, int worker)
+{
+  csr_visibility_triangle tri = {0};
+  int index_row = item * context->width;
+  float py = (float)item + 0.5f;
+  int x, k;
+
+  (void)worker;
+
+  tri.id = CSR_VISIBILITY_EMPTY;
+
+  for (x = 0; x < context->width; ++x)
+  {
+    unsigned int id = context->visibility[index_row + x];
+    float px = (float)x + 0.5f;
+    float b1, b2, shaded[3];
+
+    if (id == CSR_VISIBILITY_EMPTY)
+    {
+      continue;
+    }
+
+    /* Neighbouring pixels mostly show the same triangle */
+    if (id != tri.id)
+    {
+      csr_visibility_triangle_setup(context, &tri, id);
+    }
+
+    b1 = tri.b1 + tri.b1_dx * px + tri.b1_dy * py;
+    b2 = tri.b2 + tri.b2_dx * px + tri.b2_dy * py;
+
+    for (k = 0; k < 3; ++k)
+    {
+      shaded[k] = csr_maxf(0.0f, csr_minf(255.0f, tri.color[0][k] + tri.color[1][k] * b1 + tri.color[2][k] * b2));
+    }
+
+    context->framebuffer[index_row + x].r = (unsigned char)(int)shaded[0];
+    context->framebuffer[index_row + x].g = (unsigned char)(int)shaded[1];
+    context->framebuffer[index_row + x].b = (unsigned char)(int)shaded[2];
+  }
+}
+
+/* Renders a command buffer like csr_execute in two passes. The first pass rasterizes depth and the id of the
+ * nearest triangle (draw and triangle index, see CSR_VISIBILITY_TRIANGLE_BITS) into the visibility buffer
+ * without computing any color. The second pass reconstructs the barycentric weights and shades every covered
+ * pixel exactly once, so the shading cost depends on the screen size instead of the overdraw. Wireframe draws
+ * are colored directly. Returns 0 without rendering if the context has no binning memory or the buffer has
+ * more draws or a draw more triangles than the ids can hold.
+ */
+CSR_API CSR_INLINE int csr_execute_visibility(csr_context *context, csr_command_buffer *buffer)
+{
+  unsigned long i;
+
+  /* With one more draw the last triangle of the last draw could get the id CSR_VISIBILITY_EMPTY */
+  if (!context->visibility || buffer->count > (1UL << (32 - CSR_VISIBILITY_TRIANGLE_BITS)) - 1)
+  {
+    return 0;
+  }
+
+  for (i = 0; i < buffer->count; ++i)
+  {
+    if (buffer->commands[i].num_indices / 3 > (1UL << CSR_VISIBILITY_TRIANGLE_BITS))
+    {
+      return 0;
+    }
+  }
+
+  for (i = 0; i < (unsigned long)(context->width * context->height); ++i)
+  {
+    context->visibility[i] = CSR_VISIBILITY_EMPTY;
+  }
+
+  context->visibility_active = 1;
+  csr_execute(context, buffer);
+  context->visibility_active = 0;
+
+  context->visibility_draws = buffer;
+  csr_parallel_for(context, context->height, csr_visibility_resolve_job);
+  context->visibility_draws = 0;
+
+  return 1;
+}
+
+/* Returns the model space camera position (homogeneous, w = 0 for orthographic projections). It is the point
+ * whose clip x, y and w are zero, the null vector of these three matrix rows (generalized cross product). The
+ * vector is oriented so that camera[a] - p * camera[3] > 0 means the camera is on the positive side of the
+ * plane p on axis a, and camera[3] >= 0.
+ */
+CSR_API CSR_INLINE void csr_m4x4_camera(float camera[4], float m[16])
+{
+  int i;
+
+  for (i = 0; i < 4; ++i)
+  {
+    float minor[3][3];
+    int r, col, c;
+
+    for (r = 0; r < 3; ++r)
+    {
+      int matrix_row = r == 2 ? 3 : r;
+
+      for (col = 0, c = 0; col < 4; ++col)
+      {
+        if (col != i)
+        {
+          minor[r][c++] = m[CSR_M4X4_AT(matrix_row, col)];
+        }
+      }
+    }
+
+    camera[i] = minor[0][0] * (minor[1][1] * minor[2][2] - minor[1][2] * minor[2][1]) -
+                minor[0][1] * (minor[1][0] * minor[2][2] - minor[1][2] * minor[2][0]) +
+                minor[0][2] * (minor[1][0] * minor[2][1] - minor[1][1] * minor[2][0]);
+    camera[i] = (i & 1) ? -camera[i] : camera[i];
+  }
+
+  if (camera[3] != 0.0f ? camera[3] < 0.0f : (m[CSR_M4X4_AT(2, 0)] * camera[0] + m[CSR_M4X4_AT(2, 1)] * camera[1] + m[CSR_M4X4_AT(2, 2)] * camera[2]) > 0.0f)
+  {
+    for (i = 0; i < 4; ++i)
+    {
+      camera[i] = -camera[i];
+    }
+  }
+}
+
+/* Returns the max. number of meshlets csr_meshlets_build creates for num_indices indices. */
+CSR_API CSR_INLINE unsigned long csr_meshlets_max(unsigned long num_indices)
+{
+  /* Meshlets are full except the last one of each of the 6 normal directions */
+  return num_indices / 3 / CSR_MESHLET_TRIANGLES + 6;
+}
+
+/* Computes the (unnormalized) normal of a triangle as the cross product of its edges. */
+CSR_API CSR_INLINE void csr_triangle_normal(float normal[3], int stride, float *vertices, int i0, int i1, int i2)
+{
+  float *v0 = &vertices[i0 * stride];
+  float *v1 = &vertices[i1 * stride];
+  float *v2 = &vertices[i2 * stride];
+  float a[3], b[3];
+  int k;
+
+  for (k = 0; k < 3; ++k)
+  {
+    a[k] = v1[k] - v0[k];
+    b[k] = v2[k] - v0[k];
+  }
+
+  normal[0] = a[1] * b[2] - a[2] * b[1];
+  normal[1] = a[2] * b[0] - a[0] * b[2];
+  normal[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+/* Sort key of a triangle: the dominant axis and sign of its normal (6 directions) in the upper bits and the
+ * Morton code of its centroid (9 bits per axis inside of the mesh bounds) in the lower 27 bits.
+ */
+CSR_API CSR_INLINE unsigned long csr_meshlet_key(float bounds[6], int stride, float *vertices, int *triangle)
+{
+  float normal[3];
+  unsigned long key = 0;
+  int axis, k, bit;
+
+  csr_triangle_normal(normal, stride, vertices, triangle[0], triangle[1], triangle[2]);
+
+  axis = csr_absf(normal[0]) >= csr_absf(normal[1]) ? 0 : 1;
+  axis = csr_absf(normal[axis]) >= csr_absf(normal[2]) ? axis : 2;
+
+  for (k = 0; k < 3; ++k)
+  {
+    float extent = bounds[k + 3] - bounds[k];
+    float centroid = (vertices[triangle[0] * stride + k] + vertices[triangle[1] * stride + k] + vertices[triangle[2] * stride + k]) / 3.0f;
+    int cell = extent > 0.0f ? (int)((centroid - bounds[k]) / extent * 511.0f) : 0;
+
+    cell = csr_maxi(0, csr_mini(511, cell));
+
+    for (bit = 0; bit < 9; ++bit)
+    {
+      key |= (unsigned long)((cell >> bit) & 1) << (bit * 3 + k);
+    }
+  }
+
+  return key | (unsigned long)(axis * 2 + (normal[axis] < 0.0f)) << 27;
+}
+
+/* Moves triangle root down the max heap of triangles [0, end) ordered by their meshlet keys. */
+CSR_API CSR_INLINE void csr_meshlet_sift_down(float bounds[6], int stride, float *vertices, int *triangles, unsigned long root, unsigned long end)
+{
+  for (;;)
+  {
+    unsigned long child = root * 2 + 1;
+    int k;
+
+    if (child >= end)
+    {
+      break;
+    }
+
+    if (child + 1 < end && csr_meshlet_key(bounds, stride, vertices, &triangles[child * 3]) < csr_meshlet_key(bounds, stride, vertices, &triangles[child * 3 + 3]))
+    {
+      ++child;
+    }
+
+    if (csr_meshlet_key(bounds, stride, vertices, &triangles[root * 3]) >= csr_meshlet_key(bounds, stride, vertices, &triangles[child * 3]))
+    {
+      break;
+    }
+
+    for (k = 0; k < 3; ++k)
+    {
+      int t = triangles[root * 3 + (unsigned long)k];
+      triangles[root * 3 + (unsigned long)k] = triangles[child * 3 + (unsigned long)k];
+      triangles[child * 3 + (unsigned long)k] = t;
+    }
+
+    root = child;
+  }
+}
+
+/* Computes the bounding sphere and the normal cone of a meshlet whose vertices and triangles are complete. */
+CSR_API CSR_INLINE void csr_meshlet_bounds(csr_meshlet *meshlet, int stride, float *vertices, int *meshlet_vertices, unsigned char *meshlet_triangles)
+{
+  int *ids = &meshlet_vertices[meshlet->vertex_offset];
+  unsigned char *local = &meshlet_triangles[meshlet->triangle_offset];
+  float box[6];
+  float axis[3] = {0.0f, 0.0f, 0.0f};
+  float radius = 0.0f, length, axis_length, min_dot = 1.0f;
+  int i, k;
+
+  /* Bounding sphere around the center of the bounding box */
+  for (k = 0; k < 3; ++k)
+  {
+    box[k] = box[k + 3] = vertices[ids[0] * stride + k];
+  }
+
+  for (i = 1; i < meshlet->vertex_count; ++i)
+  {
+    for (k = 0; k < 3; ++k)
+    {
+      box[k] = csr_minf(box[k], vertices[ids[i] * stride + k]);
+      box[k + 3] = csr_maxf(box[k + 3], vertices[ids[i] * stride + k]);
+    }
+  }
+
+  for (k = 0; k < 3; ++k)
+  {
+    meshlet->center[k] = (box[k] + box[k + 3]) * 0.5f;
+  }
+
+  for (i = 0; i < meshlet->vertex_count; ++i)
+  {
+    float dx = vertices[ids[i] * stride + 0] - meshlet->center[0];
+    float dy = vertices[ids[i] * stride + 1] - meshlet->center[1];
+    float dz = vertices[ids[i] * stride + 2] - meshlet->center[2];
+
+    radius = csr_maxf(radius, dx * dx + dy * dy + dz * dz);
+  }
+
+  meshlet->radius = csr_sqrtf(radius);
+
+  /* Normal cone: the axis is the average of the unit normals, the cutoff the sine of the widest angle to it */
+  for (i = 0; i < meshlet->triangle_count * 3; i += 3)
+  {
+    float normal[3];
+
+    csr_triangle_normal(normal, stride, vertices, ids[local[i]], ids[local[i + 1]], ids[local[i + 2]]);
+    length = csr_sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+    for (k = 0; length > 0.0f && k < 3; ++k)
+    {
+      axis[k] += normal[k] / length;
+    }
+  }
+
+  axis_length = csr_sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+
+  for (k = 0; k < 3; ++k)
+  {
+    meshlet->cone_axis[k] = axis_length > 0.0f ? axis[k] / axis_length : 0.0f;
+  }
+
+  for (i = 0; i < meshlet->triangle_count * 3; i += 3)
+  {
+    float normal[3];
+
+    csr_triangle_normal(normal, stride, vertices, ids[local[i]], ids[local[i + 1]], ids[local[i + 2]]);
+    length = csr_sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+    /* Degenerate triangles are culled by any culling mode */
+    if (length > 0.0f)
+    {
+      min_dot = csr_minf(min_dot, (normal[0] * meshlet->cone_axis[0] + normal[1] * meshlet->cone_axis[1] + normal[2] * meshlet->cone_axis[2]) / length);
+    }
+  }
+
+  /* Cones of 90 degrees and wider can not be back facing as a whole */
+  meshlet->cone_cutoff = (axis_length > 0.0f && min_dot > 0.0f) ? csr_sqrtf(1.0f - min_dot * min_dot) + CSR_MESHLET_CONE_TOLERANCE : 2.0f;
+}
+
+/* Splits an indexed mesh into meshlets of up to CSR_MESHLET_TRIANGLES triangles and returns their number.
+ * Triangles are grouped by the direction of their normal and sorted along a space filling curve, so meshlets
+ * are compact and mostly face one direction. The caller provides csr_meshlets_max(num_indices) meshlets,
+ * num_indices ints for meshlet_vertices and num_indices bytes for meshlet_triangles. Meshlets can be built
+ * once offline and rendered with csr_render_meshlets.
+ */
+CSR_API CSR_INLINE unsigned long csr_meshlets_build(csr_meshlet *meshlets, int *meshlet_vertices, unsigned char *meshlet_triangles, int stride, float *vertices, unsigned long num_vertices, int *indices, unsigned long num_indices)
+{
+  unsigned long triangles = num_indices / 3;
+  unsigned long count = 0;
+  unsigned long vertex_end = 0;
+  unsigned long t, i;
+  float bounds[6];
+  csr_meshlet *meshlet = 0;
+  unsigned long direction = 0;
+
+  csr_mesh_bounds(bounds, stride, vertices, num_vertices);
+
+  /* Sort a copy of the triangles in meshlet_vertices (heap sort, no extra memory) */
+  for (i = 0; i < triangles * 3; ++i)
+  {
+    meshlet_vertices[i] = indices[i];
+  }
+
+  for (t = triangles / 2; t > 0; --t)
+  {
+    csr_meshlet_sift_down(bounds, stride, vertices, meshlet_vertices, t - 1, triangles);
+  }
+
+  for (t = triangles; t > 1; --t)
+  {
+    int k;
+
+    for (k = 0; k < 3; ++k)
+    {
+      int swap = meshlet_vertices[k];
+      meshlet_vertices[k] = meshlet_vertices[(t - 1) * 3 + (unsigned long)k];
+      meshlet_vertices[(t - 1) * 3 + (unsigned long)k] = swap;
+    }
+
+    csr_meshlet_sift_down(bounds, stride, vertices, meshlet_vertices, 0, t - 1);
+  }
+
+  /* Fill the meshlets in sorted order. The vertex lists overwrite the sorted triangles in place: a meshlet
+   * never has more vertices than indices, so writes stay behind the triangle being read.
+   */
+  for (t = 0; t < triangles; ++t)
+  {
+    int triangle[3];
+    unsigned long triangle_direction = csr_meshlet_key(bounds, stride, vertices, &meshlet_vertices[t * 3]) >> 27;
+    int k, v;
+
+    triangle[0] = meshlet_vertices[t * 3];
+    triangle[1] = meshlet_vertices[t * 3 + 1];
+    triangle[2] = meshlet_vertices[t * 3 + 2];
+
+    if (!meshlet || meshlet->triangle_count == CSR_MESHLET_TRIANGLES || triangle_direction != direction)
+    {
+      if (meshlet)
+      {
+        csr_meshlet_bounds(meshlet, stride, vertices, meshlet_vertices, meshlet_triangles);
+      }
+
+      meshlet = &meshlets[count++];
+      meshlet->vertex_offset = vertex_end;
+      meshlet->triangle_offset = t * 3;
+      meshlet->vertex_count = 0;
+      meshlet->triangle_count = 0;
+      direction = triangle_direction;
+    }
+
+    for (k = 0; k < 3; ++k)
+    {
+      for (v = 0; v < meshlet->vertex_count && meshlet_vertices[meshlet->vertex_offset + (unsigned long)v] != triangle[k]; ++v)
+      {
+      }
+
+      if (v == meshlet->vertex_count)
+      {
+        meshlet_vertices[vertex_end++] = triangle[k];
+        meshlet->vertex_count++;
+      }
+
+      meshlet_triangles[t * 3 + (unsigned long)k] = (unsigned char)v;
+    }
+
+    meshlet->triangle_count++;
+  }
+
+  if (meshlet)
+  {
+    csr_meshlet_bounds(meshlet, stride, vertices, meshlet_vertices, meshlet_triangles);
+  }
+
+  return count;
+}
+
+/* Returns 1 if a meshlet can be skipped: its bounding sphere is outside of one of the frustum planes (model
+ * space, see csr_render_meshlets) or all of its triangles face to the side removed by the culling mode.
+ */
+CSR_API CSR_INLINE int csr_meshlet_culled(csr_meshlet *meshlet, csr_culling_mode culling_mode, float planes[6][4], float camera[4])
+{
+  float view[3];
+  float t, sign;
+  int i;
+
+  for (i = 0; i < 6; ++i)
+  {
+    float s = planes[i][0] * meshlet->center[0] + planes[i][1] * meshlet->center[1] + planes[i][2] * meshlet->center[2] + planes[i][3];
+    float plane_length2 = planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2];
+
+    if (s < 0.0f && s * s > meshlet->radius * meshlet->radius * plane_length2)
+    {
+      return 1;
+    }
+  }
+
+  if (culling_mode == CSR_CULLING_DISABLED || meshlet->cone_cutoff > 1.0f)
+  {
+    return 0;
+  }
+
+  /* Triangles whose normal points away from the camera are kept by CCW_BACKFACE and CW_FRONTFACE */
+  sign = (culling_mode == CSR_CULLING_CCW_BACKFACE || culling_mode == CSR_CULLING_CW_FRONTFACE) ? -1.0f : 1.0f;
+
+  /* The normals of all triangles point away from the camera (times sign) if the direction from the camera to
+   * the sphere center is inside of the cone by more than the radius
+   */
+  for (i = 0; i < 3; ++i)
+  {
+    view[i] = meshlet->center[i] * camera[3] - camera[i];
+  }
+
+  t = sign * (view[0] * meshlet->cone_axis[0] + view[1] * meshlet->cone_axis[1] + view[2] * meshlet->cone_axis[2]) - meshlet->radius * camera[3];
+
+  return t > 0.0f && t * t > meshlet->cone_cutoff * meshlet->cone_cutoff * (view[0] * view[0] + view[1] * view[1] + view[2] * view[2]);
+}
+
+/* Renders meshlets built by csr_meshlets_build and returns the number of meshlets drawn. Meshlets outside of the
+ * frustum or facing away as a whole (with culling enabled) are skipped before any of their vertices is
+ * transformed, the others are transformed and rasterized like csr_render with their triangles in meshlet order.
+ */
+CSR_API CSR_INLINE unsigned long csr_render_meshlets(csr_context *context, csr_render_mode render_mode, csr_culling_mode culling_mode, int stride, float *vertices, csr_meshlet *meshlets, unsigned long meshlet_count, int *meshlet_vertices, unsigned char *meshlet_triangles, float projection_view_model_matrix[16])
+{
+  float *m = projection_view_model_matrix;
+  float positions[3][CSR_VERTEX_BATCH_SIZE];
+  float clip[4][CSR_VERTEX_BATCH_SIZE];
+  float screen[3][CSR_MESHLET_VERTICES];
+  float screen_w[CSR_MESHLET_VERTICES];
+  float *positions_ptr[3];
+  float *clip_ptr[4];
+  float planes[6][4];
+  float camera[4];
+  unsigned long drawn = 0;
+  unsigned long i;
+  int timer_started = CSR_TIMER_START(context);
+  int k;
+
+  positions_ptr[0] = positions[0];
+  positions_ptr[1] = positions[1];
+  positions_ptr[2] = positions[2];
+  clip_ptr[0] = clip[0];
+  clip_ptr[1] = clip[1];
+  clip_ptr[2] = clip[2];
+  clip_ptr[3] = clip[3];
+
+  /* Model space planes of clip x >= -w, x <= w, y >= -w, y <= w, z <= w and w >= 0 */
+  for (k = 0; k < 4; ++k)
+  {
+    planes[0][k] = m[CSR_M4X4_AT(3, k)] + m[CSR_M4X4_AT(0, k)];
+    planes[1][k] = m[CSR_M4X4_AT(3, k)] - m[CSR_M4X4_AT(0, k)];
+    planes[2][k] = m[CSR_M4X4_AT(3, k)] + m[CSR_M4X4_AT(1, k)];
+    planes[3][k] = m[CSR_M4X4_AT(3, k)] - m[CSR_M4X4_AT(1, k)];
+    planes[4][k] = m[CSR_M4X4_AT(3, k)] - m[CSR_M4X4_AT(2, k)];
+    planes[5][k] = m[CSR_M4X4_AT(3, k)];
+  }
+
+  csr_m4x4_camera(camera, m);
+
+  context->mode = render_mode;
+
+  for (i = 0; i < meshlet_count; ++i)
+  {
+    csr_meshlet *meshlet = &meshlets[i];
+    int *ids = &meshlet_vertices[meshlet->vertex_offset];
+    unsigned char *local = &meshlet_triangles[meshlet->triangle_offset];
+    int batch;
+
+    if (csr_meshlet_culled(meshlet, culling_mode, planes, camera))
+    {
+      continue;
+    }
+
+    drawn++;
+
+    CSR_TIMER_LAP(context, CSR_STAGE_CULL);
+
+    /* 1. - 3. Transform, divide and project the vertices of the meshlet */
+    for (batch = 0; batch < meshlet->vertex_count; batch += CSR_VERTEX_BATCH_SIZE)
+    {
+      int count = csr_mini(meshlet->vertex_count - batch, CSR_VERTEX_BATCH_SIZE);
+
+      for (k = 0; k < count; ++k)
+      {
+        float *vertex = &vertices[ids[batch + k] * stride];
+
+        positions[0][k] = vertex[0];
+        positions[1][k] = vertex[1];
+        positions[2][k] = vertex[2];
+      }
+
+      context->kernels.transform(m, positions_ptr, clip_ptr, count);
+
+      for (k = 0; k < count; ++k)
+      {
+        float transformed[4];
+        float ndc[4];
+        float projected[3];
+
+        screen_w[batch + k] = clip[3][k];
+
+        if (clip[3][k] <= 0.0f)
+        {
+          continue;
+        }
+
+        csr_pos_init(transformed, clip[0][k], clip[1][k], clip[2][k], clip[3][k]);
+        csr_v4_divf(ndc, transformed, transformed[3]);
+        csr_ndc_to_screen(context, projected, ndc);
+
+        screen[0][batch + k] = projected[0];
+        screen[1][batch + k] = projected[1];
+        screen[2][batch + k] = projected[2];
+      }
+    }
+
+    CSR_TIMER_LAP(context, CSR_STAGE_TRANSFORM);
+
+    for (k = 0; k < meshlet->triangle_count * 3; k += 3)
+    {
+      int l0 = local[k];
+      int l1 = local[k + 1];
+      int l2 = local[k + 2];
+
+      float v0_screen[3];
+      float v1_screen[3];
+      float v2_screen[3];
+
+      /* Check if the triangle is behind the camera (clipping) */
+      if (screen_w[l0] <= 0.0f || screen_w[l1] <= 0.0f || screen_w[l2] <= 0.0f)
+      {
+        CSR_STATS_ADD(&context->stats[0], triangles_submitted, 1);
+        CSR_STATS_ADD(&context->stats[0], triangles_w_rejected, 1);
+        continue;
+      }
+
+      v0_screen[0] = screen[0][l0], v0_screen[1] = screen[1][l0], v0_screen[2] = screen[2][l0];
+      v1_screen[0] = screen[0][l1], v1_screen[1] = screen[1][l1], v1_screen[2] = screen[2][l1];
+      v2_screen[0] = screen[0][l2], v2_screen[1] = screen[1][l2], v2_screen[2] = screen[2][l2];
+
+      csr_render_triangle(context, render_mode, culling_mode, stride, vertices, ids[l0], ids[l1], ids[l2], v0_screen, v1_screen, v2_screen);
+    }
+  }
+
+  CSR_TIMER_LAP(context, CSR_STAGE_CULL);
+  CSR_TIMER_STOP(context, timer_started);
+
+  /* Rasterize the binned triangles of all meshlets tile by tile */
+  csr_tiles_flush(context);
+
+  context->mode = CSR_RENDER_SOLID;
+
+  return drawn;
+}
+
+/* Returns the memory size csr_simplify and csr_lods_build need for a mesh. */
+CSR_API CSR_INLINE unsigned long csr_simplify_memory_size(int stride, unsigned long num_vertices, unsigned long num_indices)
+{
+  unsigned long vertex_count = num_vertices / (unsigned long)stride;
+
+  return csr_memory_align((vertex_count + 1) * (unsigned long)sizeof(unsigned long)) + /* adjacency offsets  */
+         csr_memory_align(num_indices * (unsigned long)sizeof(int)) +                  /* adjacent triangles */
+         csr_memory_align(num_indices * 2 * (unsigned long)sizeof(csr_collapse)) +     /* collapses          */
+         csr_memory_align(vertex_count * 10 * (unsigned long)sizeof(float)) +          /* quadrics           */
+         csr_memory_align(vertex_count * (unsigned long)sizeof(int)) +                 /* remap              */
+         csr_memory_align(vertex_count);                                               /* locks              */
+}
+
+/* Adds the squared distance to the plane n . p + d = 0 (n of unit length) times weight to a quadric.
+ * Quadrics store the symmetric matrix A (6 floats), the vector b (3 floats) and c of p A p + 2 b p + c.
+ */
+CSR_API CSR_INLINE void csr_quadric_add_plane(float quadric[10], float n[3], float d, float weight)
+{
+  quadric[0] += weight * n[0] * n[0];
+  quadric[1] += weight * n[0] * n[1];
+  quadric[2] += weight * n[0] * n[2];
+  quadric[3] += weight * n[1] * n[1];
+  quadric[4] += weight * n[1] * n[2];
+  quadric[5] += weight * n[2] * n[2];
+  quadric[6] += weight * n[0] * d;
+  quadric[7] += weight * n[1] * d;
+  quadric[8] += weight * n[2] * d;
+  quadric[9] += weight * d * d;
+}
+
+/* Returns the error of the sum of two quadrics at position p. */
+CSR_API CSR_INLINE float csr_quadric_error(float a[10], float b[10], float *p)
+{
+  float q[10];
+  int k;
+
+  for (k = 0; k < 10; ++k)
+  {
+    q[k] = a[k] + b[k];
+  }
+
+  return q[0] * p[0] * p[0] + q[3] * p[1] * p[1] + q[5] * p[2] * p[2] +
+         2.0f * (q[1] * p[0] * p[1] + q[2] * p[0] * p[2] + q[4] * p[1] * p[2]) +
+         2.0f * (q[6] * p[0] + q[7] * p[1] + q[8] * p[2]) + q[9];
+}
+
+/* Lists the triangles around each vertex: adjacency[offsets[v]] to adjacency[offsets[v + 1]] for vertex v. */
+CSR_API CSR_INLINE void csr_simplify_adjacency(unsigned long *offsets, int *adjacency, unsigned long vertex_count, int *indices, unsigned long num_indices)
+{
+  unsigned long i, v;
+
+  for (v = 0; v <= vertex_count; ++v)
+  {
+    offsets[v] = 0;
+  }
+
+  for (i = 0; i < num_indices; ++i)
+  {
+    offsets[indices[i] + 1]++;
+  }
+
+  for (v = 0; v < vertex_count; ++v)
+  {
+    offsets[v + 1] += offsets[v];
+  }
+
+  for (i = 0; i < num_indices; ++i)
+  {
+    adjacency[offsets[indices[i]]++] = (int)(i / 3);
+  }
+
+  /* The fill loop moved every offset to the start of the next vertex */
+  for (v = vertex_count; v > 0; --v)
+  {
+    offsets[v] = offsets[v - 1];
+  }
+
+  offsets[0] = 0;
+}
+
+/* Returns 1 if the edge a, b of triangle t is used by no other triangle (an open border of the mesh). */
+CSR_API CSR_INLINE int csr_simplify_border_edge(unsigned long *offsets, int *adjacency, int *indices, int t, int a, int b)
+{
+  unsigned long i;
+
+  for (i = offsets[a]; i < offsets[a + 1]; ++i)
+  {
+    int *triangle = &indices[adjacency[i] * 3];
+
+    if (adjacency[i] != t && (triangle[0] == b || triangle[1] == b || triangle[2] == b))
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* Moves collapse root down the max heap of collapses [0, end) ordered by their cost. */
+CSR_API CSR_INLINE void csr_collapse_sift_down(csr_collapse *collapses, unsigned long root, unsigned long end)
+{
+  for (;;)
+  {
+    unsigned long child = root * 2 + 1;
+    csr_collapse swap;
+
+    if (child >= end)
+    {
+      break;
+    }
+
+    if (child + 1 < end && collapses[child].cost < collapses[child + 1].cost)
+    {
+      child++;
+    }
+
+    if (collapses[root].cost >= collapses[child].cost)
+    {
+      break;
+    }
+
+    swap = collapses[root];
+    collapses[root] = collapses[child];
+    collapses[child] = swap;
+    root = child;
+  }
+}
+
+/* Returns 1 if moving vertex from onto vertex to turns one of the remaining triangles around from by more than
+ * 75 degrees (or flips it), which would fold the surface.
+ */
+CSR_API CSR_INLINE int csr_simplify_flips(unsigned long *offsets, int *adjacency, int *indices, int stride, float *vertices, int from, int to)
+{
+  unsigned long i;
+
+  for (i = offsets[from]; i < offsets[from + 1]; ++i)
+  {
+    int *triangle = &indices[adjacency[i] * 3];
+    int moved[3];
+    float before[3], after[3];
+    float dot, length_before, length_after;
+    int k;
+
+    if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+    {
+      continue;
+    }
+
+    for (k = 0; k < 3; ++k)
+    {
+      moved[k] = triangle[k] == from ? to : triangle[k];
+    }
+
+    csr_triangle_normal(before, stride, vertices, triangle[0], triangle[1], triangle[2]);
+    csr_triangle_normal(after, stride, vertices, moved[0], moved[1], moved[2]);
+
+    dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+    length_before = before[0] * before[0] + before[1] * before[1] + before[2] * before[2];
+    length_after = after[0] * after[0] + after[1] * after[1] + after[2] * after[2];
+
+    /* Degenerate triangles have no direction to keep */
+    if (length_before > 0.0f && (dot <= 0.0f || 16.0f * dot * dot < length_before * length_after))
+    {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* Simplifies an indexed triangle mesh to about target_index_count indices by collapsing edges with the lowest
+ * quadric error (Garland and Heckbert). Vertices are moved onto their neighbours instead of new positions, so
+ * the result still indexes the original vertices. Writes the triangles to destination (which may be indices)
+ * and returns the number of indices written, which stays above the target if further collapses would fold
+ * the surface. memory must hold csr_simplify_memory_size bytes, 0 is returned if it does not.
+ */
+CSR_API CSR_INLINE unsigned long csr_simplify(int *destination, int *indices, unsigned long num_indices, int stride, float *vertices, unsigned long num_vertices, unsigned long target_index_count, void *memory, unsigned long memory_size)
+{
+  unsigned long vertex_count = num_vertices / (unsigned long)stride;
+  unsigned long count = num_indices / 3 * 3;
+  unsigned long *offsets = (unsigned long *)memory;
+  int *adjacency = (int *)((char *)offsets + csr_memory_align((vertex_count + 1) * (unsigned long)sizeof(unsigned long)));
+  csr_collapse *collapses = (csr_collapse *)((char *)adjacency + csr_memory_align(num_indices * (unsigned long)sizeof(int)));
+  float *quadrics = (float *)((char *)collapses + csr_memory_align(num_indices * 2 * (unsigned long)sizeof(csr_collapse)));
+  int *remap = (int *)((char *)quadrics + csr_memory_align(vertex_count * 10 * (unsigned long)sizeof(float)));
+  unsigned char *locked = (unsigned char *)((char *)remap + csr_memory_align(vertex_count * (unsigned long)sizeof(int)));
+  unsigned long i, v;
+  int k;
+
+  if (!memory || memory_size < csr_simplify_memory_size(stride, num_vertices, num_indices))
+  {
+    return 0;
+  }
+
+  for (i = 0; i < count; ++i)
+  {
+    destination[i] = indices[i];
+  }
+
+  for (i = 0; i < vertex_count * 10; ++i)
+  {
+    quadrics[i] = 0.0f;
+  }
+
+  csr_simplify_adjacency(offsets, adjacency, vertex_count, destination, count);
+
+  /* Quadric of each vertex: the planes of its triangles weighted by their area, plus planes perpendicular to the
+   * triangles along open borders so that borders do not shrink
+   */
+  for (i = 0; i < count; i += 3)
+  {
+    int *triangle = &destination[i];
+    float normal[3];
+    float length;
+
+    csr_triangle_normal(normal, stride, vertices, triangle[0], triangle[1], triangle[2]);
+    length = csr_sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+    if (length <= 0.0f)
+    {
+      continue;
+    }
+
+    normal[0] /= length, normal[1] /= length, normal[2] /= length;
+
+    for (k = 0; k < 3; ++k)
+    {
+      int a = triangle[k];
+      int b = triangle[(k + 1) % 3];
+      float *pa = &vertices[a * stride];
+      float *pb = &vertices[b * stride];
+      float edge[3], border[3];
+      float edge_length2, border_length;
+
+      csr_quadric_add_plane(&quadrics[a * 10], normal, -(normal[0] * pa[0] + normal[1] * pa[1] + normal[2] * pa[2]), length * 0.5f);
+
+      if (!csr_simplify_border_edge(offsets, adjacency, destination, (int)(i / 3), a, b))
+      {
+        continue;
+      }
+
+      edge[0] = pb[0] - pa[0], edge[1] = pb[1] - pa[1], edge[2] = pb[2] - pa[2];
+      edge_length2 = edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2];
+
+      border[0] = edge[1] * normal[2] - edge[2] * normal[1];
+      border[1] = edge[2] * normal[0] - edge[0] * normal[2];
+      border[2] = edge[0] * normal[1] - edge[1] * normal[0];
+      border_length = csr_sqrtf(border[0] * border[0] + border[1] * border[1] + border[2] * border[2]);
+
+      if (border_length > 0.0f)
+      {
+        float d;
+
+        border[0] /= border_length, border[1] /= border_length, border[2] /= border_length;
+        d = -(border[0] * pa[0] + border[1] * pa[1] + border[2] * pa[2]);
+
+        csr_quadric_add_plane(&quadrics[a * 10], border, d, edge_length2 * CSR_SIMPLIFY_BORDER_WEIGHT);
+        csr_quadric_add_plane(&quadrics[b * 10], border, d, edge_length2 * CSR_SIMPLIFY_BORDER_WEIGHT);
+      }
+    }
+  }
+
+  /* Each pass collapses the cheapest edges whose triangles are not touched by another collapse of the pass */
+  while (count > target_index_count)
+  {
+    unsigned long collapse_count = 0;
+    unsigned long triangles = count / 3;
+    unsigned long collapsed = 0;
+    unsigned long kept = 0;
+
+    csr_simplify_adjacency(offsets, adjacency, vertex_count, destination, count);
+
+    for (i = 0; i < count; i += 3)
+    {
+      for (k = 0; k < 3; ++k)
+      {
+        int a = destination[i + (unsigned long)k];
+        int b = destination[i + (unsigned long)((k + 1) % 3)];
+
+        /* Inner edges are shared by two triangles in opposite directions, only the one with a < b is used */
+        if (a > b && !csr_simplify_border_edge(offsets, adjacency, destination, (int)(i / 3), a, b))
+        {
+          continue;
+        }
+
+        collapses[collapse_count].from = a;
+        collapses[collapse_count].to = b;
+        collapses[collapse_count].cost = csr_quadric_error(&quadrics[a * 10], &quadrics[b * 10], &vertices[b * stride]);
+        collapse_count++;
+
+        collapses[collapse_count].from = b;
+        collapses[collapse_count].to = a;
+        collapses[collapse_count].cost = csr_quadric_error(&quadrics[a * 10], &quadrics[b * 10], &vertices[a * stride]);
+        collapse_count++;
+      }
+    }
+
+    /* Heap sort, cheapest collapse first */
+    for (i = collapse_count / 2; i > 0; --i)
+    {
+      csr_collapse_sift_down(collapses, i - 1, collapse_count);
+    }
+
+    for (i = collapse_count; i > 1; --i)
+    {
+      csr_collapse swap = collapses[0];
+      collapses[0] = collapses[i - 1];
+      collapses[i - 1] = swap;
+
+      csr_collapse_sift_down(collapses, 0, i - 1);
+    }
+
+    for (v = 0; v < vertex_count; ++v)
+    {
+      remap[v] = (int)v;
+      locked[v] = 0;
+    }
+
+    for (i = 0; i < collapse_count && triangles * 3 > target_index_count; ++i)
+    {
+      int from = collapses[i].from;
+      int to = collapses[i].to;
+      unsigned long j;
+
+      if (locked[from] || locked[to] || csr_simplify_flips(offsets, adjacency, destination, stride, vertices, from, to))
+      {
+        continue;
+      }
+
+      remap[from] = to;
+
+      for (k = 0; k < 10; ++k)
+      {
+        quadrics[to * 10 + k] += quadrics[from * 10 + k];
+      }
+
+      /* Lock the vertices of all triangles that change or share a vertex whose quadric changed */
+      for (j = offsets[from]; j < offsets[from + 1]; ++j)
+      {
+        int *triangle = &destination[adjacency[j] * 3];
+
+        triangles -= (unsigned long)(triangle[0] == to || triangle[1] == to || triangle[2] == to);
+        locked[triangle[0]] = locked[triangle[1]] = locked[triangle[2]] = 1;
+      }
+
+      for (j = offsets[to]; j < offsets[to + 1]; ++j)
+      {
+        int *triangle = &destination[adjacency[j] * 3];
+
+        locked[triangle[0]] = locked[triangle[1]] = locked[triangle[2]] = 1;
+      }
+
+      collapsed++;
+    }
+
+    if (collapsed == 0)
+    {
+      break;
+    }
+
+    /* Apply the collapses and drop the triangles that became degenerate */
+    for (i = 0; i < count; i += 3)
+    {
+      int a = remap[destination[i]];
+      int b = remap[destination[i + 1]];
+      int c = remap[destination[i + 2]];
+
+      if (a == b || b == c || c == a)
+      {
+        continue;
+      }
+
+      destination[kept++] = a;
+      destination[kept++] = b;
+      destination[kept++] = c;
+    }
+
+    count = kept;
+  }
+
+  return count;
+}
+
+/* Returns the max. number of indices csr_lods_build writes for a mesh with num_indices indices. */
+CSR_API CSR_INLINE unsigned long csr_lods_indices_max(unsigned long num_indices)
+{
+  /* Each level has at most 3/4 of the indices of the previous one */
+  return num_indices * 4;
+}
+
+/* Builds a chain of up to max_lods levels of detail and returns their number. Level 0 is a copy of the mesh,
+ * each further level is simplified to about half of the triangles of the previous one until that stops
+ * working (e.g. for a closed mesh at a few triangles). lod_indices must hold csr_lods_indices_max(num_indices)
+ * ints and memory csr_simplify_memory_size bytes. The levels are meant to be built once, e.g. when loading.
+ */
+CSR_API CSR_INLINE int csr_lods_build(csr_lod *lods, int max_lods, int *lod_indices, int stride, float *vertices, unsigned long num_vertices, int *indices, unsigned long num_indices, void *memory, unsigned long memory_size)
+{
+  int count = 1;
+  unsigned long i;
+
+  if (max_lods < 1 || memory_size < csr_simplify_memory_size(stride, num_vertices, num_indices))
+  {
+    return 0;
+  }
+
+  lods[0].index_offset = 0;
+  lods[0].index_count = num_indices / 3 * 3;
+
+  for (i = 0; i < lods[0].index_count; ++i)
+  {
+    lod_indices[i] = indices[i];
+  }
+
+  while (count < max_lods)
+  {
+    csr_lod *previous = &lods[count - 1];
+    unsigned long offset = previous->index_offset + previous->index_count;
+    unsigned long target = previous->index_count / 6 * 3;
+    unsigned long result;
+
+    if (previous->index_count < 3 * 8)
+    {
+      break;
+    }
+
+    result = csr_simplify(&lod_indices[offset], &lod_indices[previous->index_offset], previous->index_count, stride, vertices, num_vertices, target, memory, memory_size);
+
+    /* Stop once the mesh can not be simplified much further */
+    if (result == 0 || result * 4 > previous->index_count * 3)
+    {
+      break;
+    }
+
+    lods[count].index_offset = offset;
+    lods[count].index_count = result;
+    count++;
+  }
+
+  return count;
+}
+
+/* Returns the level of detail whose triangle count fits the screen area of a mesh with the given model space
+ * bounds: the most detailed level with at most one triangle per CSR_LOD_PIXELS_PER_TRIANGLE pixels of the
+ * projected bounding sphere, or the least detailed one. Level 0 is used if the camera is inside the sphere.
+ */
+CSR_API CSR_INLINE int csr_lod_select(csr_context *context, csr_lod *lods, int lod_count, float projection_view_model_matrix[16], float bounds[6])
+{
+  float *m = projection_view_model_matrix;
+  float center[4], clip[4];
+  float dx = bounds[3] - bounds[0];
+  float dy = bounds[4] - bounds[1];
+  float dz = bounds[5] - bounds[2];
+  float radius = csr_sqrtf(dx * dx + dy * dy + dz * dz) * 0.5f;
+  float scale_x, scale_y, pixels, area;
+  int lod;
+
+  csr_pos_init(center, (bounds[0] + bounds[3]) * 0.5f, (bounds[1] + bounds[4]) * 0.5f, (bounds[2] + bounds[5]) * 0.5f, 1.0f);
+  csr_m4x4_mul_v4(clip, m, center);
+
+  /* The largest screen space scale of a model space length along the clip x and y rows */
+  scale_x = csr_sqrtf(m[CSR_M4X4_AT(0, 0)] * m[CSR_M4X4_AT(0, 0)] + m[CSR_M4X4_AT(0, 1)] * m[CSR_M4X4_AT(0, 1)] + m[CSR_M4X4_AT(0, 2)] * m[CSR_M4X4_AT(0, 2)]);
+  scale_y = csr_sqrtf(m[CSR_M4X4_AT(1, 0)] * m[CSR_M4X4_AT(1, 0)] + m[CSR_M4X4_AT(1, 1)] * m[CSR_M4X4_AT(1, 1)] + m[CSR_M4X4_AT(1, 2)] * m[CSR_M4X4_AT(1, 2)]);
+  scale_x *= (float)context->width * 0.5f;
+  scale_y *= (float)context->height * 0.5f;
+
+  /* Close to the camera the sphere is not a disc anymore, but any level but 0 would be too coarse anyway */
+  if (clip[3] <= radius * csr_sqrtf(m[CSR_M4X4_AT(3, 0)] * m[CSR_M4X4_AT(3, 0)] + m[CSR_M4X4_AT(3, 1)] * m[CSR_M4X4_AT(3, 1)] + m[CSR_M4X4_AT(3, 2)] * m[CSR_M4X4_AT(3, 2)]))
+  {
+    return 0;
+  }
+
+  pixels = radius * csr_maxf(scale_x, scale_y) / clip[3];
+  area = 3.14159265f * pixels * pixels;
+
+  for (lod = 0; lod + 1 < lod_count; ++lod)
+  {
+    if ((float)(lods[lod].index_count / 3) * CSR_LOD_PIXELS_PER_TRIANGLE <= area)
+    {
+      break;
+    }
+  }
+
+  return lod;
+}
+
+/* Renders the level of detail of a chain built by csr_lods_build that fits the screen size of the mesh (see
+ * csr_lod_select) and returns it. The levels share the vertices, so the image only differs in the detail.
+ */
+CSR_API CSR_INLINE int csr_render_lod(csr_context *context, csr_render_mode render_mode, csr_culling_mode culling_mode, int stride, float *vertices, unsigned long num_vertices, int *lod_indices, csr_lod *lods, int lod_count, float projection_view_model_matrix[16])
+{
+  float bounds[6];
+  int lod;
+
+  csr_mesh_bounds(bounds, stride, vertices, num_vertices);
+
+  lod = csr_lod_select(context, lods, lod_count, projection_view_model_matrix, bounds);
+
+  csr_render_bounded(context, render_mode, culling_mode, stride, vertices, num_vertices, &lod_indices[lods[lod].index_offset], lods[lod].index_count, projection_view_model_matrix, bounds);
+
+  return lod;
+}
+
+/* Flat shaded colors of the voxel faces perpendicular to the x, y and z axis. */
+CSR_API CSR_INLINE void csr_voxel_colors(csr_color colors[3], csr_color color)
+{
+  int shade[3];
+  int i;
+
+  shade[0] = 204;
+  shade[1] = 255;
+  shade[2] = 230;
+
+  for (i = 0; i < 3; ++i)
+  {
+    colors[i].r = (unsigned char)((int)color.r * shade[i] / 255);
+    colors[i].g = (unsigned char)((int)color.g * shade[i] / 255);
+    colors[i].b = (unsigned char)((int)color.b * shade[i] / 255);
+  }
+}
+
+/* Draws the face of voxel grid cell (u, v) on the plane at coordinate plane of the given axis (0 = x, 1 = y, 2 = z). */
+CSR_API CSR_INLINE void csr_render_voxel_face(csr_context *context, csr_render_mode render_mode, float m[16], int axis, int plane, int u, int v, csr_color color)
+{
+  float screen[4][3];
+  int corner, row;
+
+  for (corner = 0; corner < 4; ++corner)
+  {
+    float p[3];
+    float transformed[4];
+    float ndc[4];
+
+    /* Corners in the order (u, v), (u + 1, v), (u + 1, v + 1), (u, v + 1) */
+    p[axis] = (float)plane;
+    p[(axis + 1) % 3] = (float)(u + (corner == 1 || corner == 2));
+    p[(axis + 2) % 3] = (float)(v + (corner >= 2));
+
+    for (row = 0; row < 4; ++row)
+    {
+      transformed[row] = m[CSR_M4X4_AT(row, 0)] * p[0] + m[CSR_M4X4_AT(row, 1)] * p[1] + m[CSR_M4X4_AT(row, 2)] * p[2] + m[CSR_M4X4_AT(row, 3)];
+    }
+
+    /* Faces touching the area behind the camera are skipped like triangles in csr_render */
+    if (transformed[3] <= 0.0f)
+    {
+      return;
+    }
+
+    csr_v4_divf(ndc, transformed, transformed[3]);
+    csr_ndc_to_screen(context, screen[corner], ndc);
+  }
+
+  if (render_mode == CSR_RENDER_WIREFRAME)
+  {
+    csr_draw_line(context, screen[0], screen[1], color);
+    csr_draw_line(context, screen[1], screen[2], color);
+    csr_draw_line(context, screen[2], screen[3], color);
+    csr_draw_line(context, screen[3], screen[0], color);
+    return;
+  }
+
+  csr_tiles_add_triangle(context, screen[0], screen[1], screen[2], color, color, color);
+  csr_tiles_add_triangle(context, screen[0], screen[2], screen[3], color, color, color);
+}
+
+/* Renders an occupancy grid (like the mvx_voxelize_mesh output) directly. Voxel (x, y, z) is set if
+ * voxels[x + y * grid_x + z * grid_x * grid_y] is not zero and covers the unit cube [x, x + 1] x [y, y + 1] x
+ * [z, z + 1] in model space. Only faces between a set and an empty voxel that face the camera are drawn, voxels
+ * are visited front to back so the hierarchical depth rejects most hidden faces. The faces are flat shaded
+ * with color darkened per axis.
+ */
+CSR_API CSR_INLINE void csr_render_voxels(csr_context *context, csr_render_mode render_mode, unsigned char *voxels, int grid_x, int grid_y, int grid_z, csr_color color, float projection_view_model_matrix[16])
+{
+  float *m = projection_view_model_matrix;
+  float camera[4];
+  csr_color colors[3];
+  int grid[3], start[3], step[3];
+  int i, x, y, z;
+
+  csr_m4x4_camera(camera, m);
+
+  csr_voxel_colors(colors, color);
+
+  grid[0] = grid_x;
+  grid[1] = grid_y;
+  grid[2] = grid_z;
+
+  for (i = 0; i < 3; ++i)
+  {
+    /* Front to back: start at the side of the grid closer to the camera */
+    step[i] = (camera[i] - (float)grid[i] * 0.5f * camera[3] > 0.0f) ? -1 : 1;
+    start[i] = step[i] > 0 ? 0 : grid[i] - 1;
+  }
+
+  context->mode = render_mode;
+
+  for (z = start[2]; z >= 0 && z < grid_z; z += step[2])
+  {
+    int z_pos = camera[2] - (float)(z + 1) * camera[3] > 0.0f; /* camera sees the +z face of this slice */
+    int z_neg = camera[2] - (float)z * camera[3] < 0.0f;       /* camera sees the -z face of this slice */
+
+    for (y = start[1]; y >= 0 && y < grid_y; y += step[1])
+    {
+      int y_pos = camera[1] - (float)(y + 1) * camera[3] > 0.0f;
+      int y_neg = camera[1] - (float)y * camera[3] < 0.0f;
+      unsigned char *row = &voxels[(long)y * grid_x + (long)z * grid_x * grid_y];
+
+      for (x = start[0]; x >= 0 && x < grid_x; x += step[0])
+      {
+        int x_pos, x_neg;
+
+        /* Empty space */
+        if (!row[x])
+        {
+          continue;
+        }
+
+        x_pos = camera[0] - (float)(x + 1) * camera[3] > 0.0f;
+        x_neg = camera[0] - (float)x * camera[3] < 0.0f;
+
+        /* A face is drawn if it faces the camera and the neighbor voxel behind it is empty */
+        if (x_pos && (x + 1 == grid_x || !row[x + 1]))
+        {
+          csr_render_voxel_face(context, render_mode, m, 0, x + 1, y, z, colors[0]);
+        }
+
+        if (x_neg && (x == 0 || !row[x - 1]))
+        {
+          csr_render_voxel_face(context, render_mode, m, 0, x, y, z, colors[0]);
+        }
+
+        if (y_pos && (y + 1 == grid_y || !row[x + grid_x]))
+        {
+          csr_render_voxel_face(context, render_mode, m, 1, y + 1, z, x, colors[1]);
+        }
+
+        if (y_neg && (y == 0 || !row[x - grid_x]))
+        {
+          csr_render_voxel_face(context, render_mode, m, 1, y, z, x, colors[1]);
+        }
+
+        if (z_pos && (z + 1 == grid_z || !row[x + grid_x * grid_y]))
+        {
+          csr_render_voxel_face(context, render_mode, m, 2, z + 1, x, y, colors[2]);
+        }
+
+        if (z_neg && (z == 0 || !row[x - grid_x * grid_y]))
+        {
+          csr_render_voxel_face(context, render_mode, m, 2, z, x, y, colors[2]);
+        }
+      }
+    }
+  }
+
+  csr_tiles_flush(context);
+
+  context->mode = CSR_RENDER_SOLID;
+}
+
+/* Inverts a 4x4 matrix with Gauss-Jordan elimination (partial pivoting). Returns 0 if it is singular. The
+ * inverse of the transpose is the transpose of the inverse, so this works for both matrix layouts.
+ */
+CSR_API CSR_INLINE int csr_m4x4_inverse(double result[16], float m[16])
+{
+  double a[4][8];
+  int row, col, pivot, k;
+
+  for (row = 0; row < 4; ++row)
+  {
+    for (col = 0; col < 4; ++col)
+    {
+      a[row][col] = (double)m[row * 4 + col];
+      a[row][col + 4] = (row == col) ? 1.0 : 0.0;
+    }
+  }
+
+  for (col = 0; col < 4; ++col)
+  {
+    double scale;
+
+    for (pivot = col, row = col + 1; row < 4; ++row)
+    {
+      if ((a[row][col] < 0.0 ? -a[row][col] : a[row][col]) > (a[pivot][col] < 0.0 ? -a[pivot][col] : a[pivot][col]))
+      {
+        pivot = row;
+      }
+    }
+
+    if (a[pivot][col] == 0.0)
+    {
+      return 0;
+    }
+
+    for (k = 0; k < 8; ++k)
+    {
+      double t = a[col][k];
+      a[col][k] = a[pivot][k];
+      a[pivot][k] = t;
+    }
+
+    scale = 1.0 / a[col][col];
+
+    for (k = 0; k < 8; ++k)
+    {
+      a[col][k] *= scale;
+    }
+
+    for (row = 0; row < 4; ++row)
+    {
+      if (row != col && a[row][col] != 0.0)
+      {
+        double factor = a[row][col];
+
+        for (k = 0; k < 8; ++k)
+        {
+          a[row][k] -= factor * a[col][k];
+        }
+      }
+    }
+  }
+
+  for (row = 0; row < 4; ++row)
+  {
+    for (col = 0; col < 4; ++col)
+    {
+      result[row * 4 + col] = a[row][col + 4];
+    }
+  }
+
+  return 1;
+}
+
+/* Casts the rays of the pixels of screen row item through the voxel grid of context->raycast (3D DDA). */
+CSR_API CSR_INLINE void csr_raycast_row_job(csr_context *context, int item, int worker)
+{
+  csr_raycast *raycast = context->raycast;
+  double *inv = raycast->inverse;
+  float *m = raycast->matrix;
+  int *grid = raycast->grid;
+  double ndc_y = 1.0 - ((double)item + 0.5) * 2.0 / (double)context->height;
+  double ndc_dx = 2.0 / (double)context->width;
+  double near_point[4], far_point[4], point_dx[4];
+  int x, i;
+
+  (void)worker;
+
+  /* The ray of a pixel runs from its position on the near plane (t = 0) to the far plane (t = 1) in model space.
+   * The homogeneous positions are linear in the pixel x, so they are stepped along the row.
+   */
+  for (i = 0; i < 4; ++i)
+  {
+    double base = inv[CSR_M4X4_AT(i, 0)] * (ndc_dx * 0.5 - 1.0) + inv[CSR_M4X4_AT(i, 1)] * ndc_y + inv[CSR_M4X4_AT(i, 3)];
+
+    near_point[i] = base - inv[CSR_M4X4_AT(i, 2)];
+    far_point[i] = base + inv[CSR_M4X4_AT(i, 2)];
+    point_dx[i] = inv[CSR_M4X4_AT(i, 0)] * ndc_dx;
+  }
+
+  for (x = 0; x < context->width; ++x)
+  {
+    float origin[3], direction[3], inv_direction[3];
+    float t_max[3], t_delta[3];
+    float t_enter = 0.0f, t_exit = 1.0f;
+    double inv_near_w = 1.0 / near_point[3];
+    double inv_far_w = 1.0 / far_point[3];
+    int voxel[3], step[3];
+    int face = 2;
+    int index = item * context->width + x;
+
+    for (i = 0; i < 3; ++i)
+    {
+      origin[i] = (float)(near_point[i] * inv_near_w);
+      direction[i] = (float)(far_point[i] * inv_far_w) - origin[i];
+      inv_direction[i] = direction[i] != 0.0f ? 1.0f / direction[i] : 0.0f;
+    }
+
+    for (i = 0; i < 4; ++i)
+    {
+      near_point[i] += point_dx[i];
+      far_point[i] += point_dx[i];
+    }
+
+    /* Clip the ray against the grid bounds [0, grid] (slab test) */
+    for (i = 0; i < 3; ++i)
+    {
+      if (direction[i] != 0.0f)
+      {
+        float t0 = -origin[i] * inv_direction[i];
+        float t1 = ((float)grid[i] - origin[i]) * inv_direction[i];
+
+        if (t0 > t1)
+        {
+          float t = t0;
+          t0 = t1;
+          t1 = t;
+        }
+
+        if (t0 > t_enter)
+        {
+          t_enter = t0;
+          face = i;
+        }
+
+        t_exit = csr_minf(t_exit, t1);
+      }
+      else if (origin[i] < 0.0f || origin[i] > (float)grid[i])
+      {
+        t_exit = -1.0f;
+      }
+    }
+
+    if (t_enter > t_exit)
+    {
+      continue;
+    }
+
+    /* Start at the voxel the ray enters and step to the next voxel boundary on the closest axis (Amanatides & Woo) */
+    for (i = 0; i < 3; ++i)
+    {
+      float p = origin[i] + direction[i] * t_enter;
+
+      voxel[i] = csr_maxi(0, csr_mini(grid[i] - 1, (int)p));
+      step[i] = direction[i] < 0.0f ? -1 : 1;
+
+      if (direction[i] != 0.0f)
+      {
+        t_max[i] = ((float)(voxel[i] + (step[i] > 0)) - origin[i]) * inv_direction[i];
+        t_delta[i] = csr_absf(inv_direction[i]);
+      }
+      else
+      {
+        t_max[i] = 2.0f;
+        t_delta[i] = 0.0f;
+      }
+    }
+
+    for (;;)
+    {
+      if (raycast->voxels[(long)voxel[0] + (long)voxel[1] * grid[0] + (long)voxel[2] * grid[0] * grid[1]])
+      {
+        float p[3];
+        float z, w;
+
+        for (i = 0; i < 3; ++i)
+        {
+          p[i] = origin[i] + direction[i] * t_enter;
+        }
+
+        /* Depth like the rasterizer: clip z / clip w of the hit point */
+        z = m[CSR_M4X4_AT(2, 0)] * p[0] + m[CSR_M4X4_AT(2, 1)] * p[1] + m[CSR_M4X4_AT(2, 2)] * p[2] + m[CSR_M4X4_AT(2, 3)];
+        w = m[CSR_M4X4_AT(3, 0)] * p[0] + m[CSR_M4X4_AT(3, 1)] * p[1] + m[CSR_M4X4_AT(3, 2)] * p[2] + m[CSR_M4X4_AT(3, 3)];
+        z /= w;
+
+        if (context->overdraw)
+        {
+          context->overdraw[index]++;
+        }
+
+        if (z < context->zbuffer[index])
+        {
+          context->framebuffer[index] = raycast->colors[face];
+          context->zbuffer[index] = z;
+        }
+
+        break;
+      }
+
+      face = (t_max[0] < t_max[1]) ? (t_max[0] < t_max[2] ? 0 : 2) : (t_max[1] < t_max[2] ? 1 : 2);
+      t_enter = t_max[face];
+      voxel[face] += step[face];
+
+      if (t_enter > t_exit || voxel[face] < 0 || voxel[face] >= grid[face])
+      {
+        break;
+      }
+
+      t_max[face] += t_delta[face];
+    }
+  }
+}
+
+/* Renders an occupancy grid like csr_render_voxels by casting a ray per pixel through the grid (3D DDA) instead
+ * of rasterizing faces. The cost depends on the screen area and the grid cells a ray crosses, not on the number
+ * of set voxels. Colors and depths are written to the framebuffer and zbuffer, so the result can be mixed with
+ * triangle draws. Rows are distributed over the worker threads. Returns 0 if the matrix is not invertible.
+ */
+CSR_API CSR_INLINE int csr_raycast_voxels(csr_context *context, unsigned char *voxels, int grid_x, int grid_y, int grid_z, csr_color color, float projection_view_model_matrix[16])
+{
+  csr_raycast raycast;
+  int i;
+
+  if (!csr_m4x4_inverse(raycast.inverse, projection_view_model_matrix))
+  {
+    return 0;
+  }
+
+  raycast.voxels = voxels;
+  raycast.grid[0] = grid_x;
+  raycast.grid[1] = grid_y;
+  raycast.grid[2] = grid_z;
+
+  for (i = 0; i < 16; ++i)
+  {
+    raycast.matrix[i] = projection_view_model_matrix[i];
+  }
+
+  csr_voxel_colors(raycast.colors, color);
+
+  /* Triangles still waiting in the bins are drawn first, the rays write the buffers directly */
+  csr_tiles_flush(context);
+  csr_clear_rect(context, 0, 0, context->width - 1, context->height - 1);
+
+  context->raycast = &raycast;
+  csr_parallel_for(context, context->height, csr_raycast_row_job);
+  context->raycast = 0;
+
+  return 1;
 }
 
 #endif /* CSR_H */
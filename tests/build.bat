@@ -8,6 +8,11 @@ rm *.ppm
 cc -s -O2 %DEF_FLAGS_COMPILER% -o %SOURCE_NAME%.exe %SOURCE_NAME%.c %DEF_FLAGS_LINKER%
 %SOURCE_NAME%.exe
 
+REM Benchmark (no files written, results as CSV)
+cc -s -O2 %DEF_FLAGS_COMPILER% -DCSR_USE_SSE -o csr_bench.exe csr_bench.c %DEF_FLAGS_LINKER%
+csr_bench.exe > csr_bench.csv
+csr_bench.exe --suite kernels > csr_bench_kernels.csv
+
 REM RENDER Videos and Gifs from PPM frames
 REM ffmpeg -y -framerate 30 -i stack_%%05d.ppm -c:v libx264 -pix_fmt yuv420p stack.mp4
 REM ffmpeg -y -framerate 30 -i cube_%%05d.ppm -c:v libx264 -pix_fmt yuv420p cube.mp4
@@ -0,0 +1,857 @@
+/* csr.h - v0.2 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, nostdlib (no C Standard Library) software renderer (CSR).
+
+Rendering benchmark: renders fixed scenes at several resolutions without writing any files and prints the frame
+times and throughput as CSV (default) or JSON. With --suite kernels it times the clear, line, triangle and
+transform kernels in isolation instead and prints the cycles per pixel, triangle or vertex.
+
+  csr_bench [--suite scenes|kernels] [--frames N] [--threads N] [--simd scalar|sse2|avx2] [--format csv|json]
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#include <stdio.h>        /* Benchmark only: print results, sprintf                              */
+#include <stdlib.h>       /* Benchmark only: malloc/free, atoi                                   */
+#include <string.h>       /* Benchmark only: strcmp                                              */
+#include "../csr.h"       /* C Software Renderer                                                 */
+#include "../deps/vm.h"   /* Linear Algebra Math Library (you can use any library that you want) */
+#if defined(CSR_USE_PTHREADS) && defined(_STRUCT_TIMESPEC)
+#define __timespec_defined /* struct timespec is already declared by pthread.h                   */
+#endif
+#include "../deps/perf.h" /* Simple Performance Profiler                                         */
+#include "../deps/mvx.h"  /* Mesh Voxelizer                                                      */
+#include "tools/teddy.h"  /* Teddy OBJ file converted to C89 arrays                              */
+#include "tools/head.h"   /* Head OBJ file                                                       */
+
+#define CSR_BENCH_FRAMES_MAX 1000
+#define CSR_BENCH_WARMUP_FRAMES 2
+
+/* Vertex data array with interleaved position and color (RGB) */
+static float cube_vertices[] = {
+    /* Position x,y,z  | Color r,g,b */
+    -0.5f, -0.5f, 0.5f, 255.0f, 0.0f, 0.0f,    /* 0: Red     */
+    0.5f, -0.5f, 0.5f, 0.0f, 255.0f, 0.0f,     /* 1: Green   */
+    0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 255.0f,      /* 2: Blue    */
+    -0.5f, 0.5f, 0.5f, 255.0f, 255.0f, 0.0f,   /* 3: Yellow  */
+    -0.5f, -0.5f, -0.5f, 255.0f, 0.0f, 255.0f, /* 4: Magenta */
+    0.5f, -0.5f, -0.5f, 0.0f, 255.0f, 255.0f,  /* 5: Cyan    */
+    0.5f, 0.5f, -0.5f, 255.0f, 255.0f, 255.0f, /* 6: White   */
+    -0.5f, 0.5f, -0.5f, 128.0f, 128.0f, 128.0f /* 7: Gray    */
+};
+
+/* Index data counterclockwise to form the triangles of a cube.  */
+static int cube_indices[] = {
+    0, 3, 2, 0, 2, 1, /* Front face (+z normal, facing camera)   */
+    4, 5, 6, 4, 6, 7, /* Back face (-z normal, away from camera) */
+    3, 7, 6, 3, 6, 2, /* Top face (+y normal)                    */
+    0, 1, 5, 0, 5, 4, /* Bottom face (-y normal)                 */
+    1, 2, 6, 1, 6, 5, /* Right face (+x normal)                  */
+    0, 4, 7, 0, 7, 3  /* Left face (-x normal)                   */
+};
+
+/* Default clear screen color */
+static csr_color clear_color = {40, 40, 40};
+
+/* Resolutions every scene is rendered at */
+static int resolutions[][2] = {{320, 240}, {800, 600}, {1920, 1080}};
+
+typedef struct csr_bench_scene
+{
+  char *name;
+  csr_culling_mode culling_mode;
+  int stride;
+  float *vertices;
+  unsigned long vertices_size;
+  int *indices;
+  unsigned long indices_size;
+
+} csr_bench_scene;
+
+typedef struct csr_bench_options
+{
+  int frames;
+  int threads;
+  csr_simd_level simd;
+  int json;
+
+} csr_bench_options;
+
+static char *csr_bench_simd_name(csr_simd_level level)
+{
+  return level == CSR_SIMD_AVX2 ? "avx2" : (level == CSR_SIMD_SSE2 ? "sse2" : "scalar");
+}
+
+/* Voxelizes a mesh into a grid and converts the set voxels into a mesh with merged faces. */
+static int csr_bench_voxelize(csr_bench_scene *scene, char *name, float *vertices, unsigned long vertices_size, int *indices, unsigned long indices_size, int grid, int pad)
+{
+  unsigned long vertices_capacity = 1000000;
+  unsigned long indices_capacity = 1000000;
+  unsigned char *voxels = (unsigned char *)malloc((unsigned long)(grid * grid * grid));
+  int result;
+
+  scene->name = name;
+  scene->culling_mode = CSR_CULLING_DISABLED;
+  scene->stride = 3;
+  scene->vertices = (float *)malloc(vertices_capacity * sizeof(float));
+  scene->indices = (int *)malloc(indices_capacity * sizeof(int));
+  scene->vertices_size = 0;
+  scene->indices_size = 0;
+
+  result = mvx_voxelize_mesh(vertices, vertices_size, indices, indices_size, grid, grid, grid, pad, pad, pad, voxels) &&
+           mvx_convert_voxels_to_mesh_greedy(voxels, grid, grid, grid, 1.0f, scene->vertices, vertices_capacity, &scene->vertices_size, scene->indices, indices_capacity, &scene->indices_size);
+
+  free(voxels);
+
+  return result;
+}
+
+/* A sphere of slices * stacks quads (two triangles each), 1000 * 500 is a million triangles. */
+static void csr_bench_sphere(csr_bench_scene *scene, char *name, int slices, int stacks)
+{
+  int slice, stack;
+  float *vertex;
+  int *index;
+
+  scene->name = name;
+  scene->culling_mode = CSR_CULLING_CCW_BACKFACE;
+  scene->stride = 3;
+  scene->vertices_size = (unsigned long)((slices + 1) * (stacks + 1) * 3);
+  scene->indices_size = (unsigned long)(slices * stacks * 6);
+  scene->vertices = (float *)malloc(scene->vertices_size * sizeof(float));
+  scene->indices = (int *)malloc(scene->indices_size * sizeof(int));
+
+  vertex = scene->vertices;
+
+  for (stack = 0; stack <= stacks; ++stack)
+  {
+    float theta = vm_radf(180.0f * (float)stack / (float)stacks);
+
+    for (slice = 0; slice <= slices; ++slice)
+    {
+      float phi = vm_radf(360.0f * (float)slice / (float)slices);
+
+      *vertex++ = vm_sinf(theta) * vm_cosf(phi);
+      *vertex++ = vm_cosf(theta);
+      *vertex++ = vm_sinf(theta) * vm_sinf(phi);
+    }
+  }
+
+  index = scene->indices;
+
+  for (stack = 0; stack < stacks; ++stack)
+  {
+    for (slice = 0; slice < slices; ++slice)
+    {
+      int i0 = stack * (slices + 1) + slice;
+      int i1 = i0 + slices + 1;
+
+      *index++ = i0;
+      *index++ = i0 + 1;
+      *index++ = i1;
+      *index++ = i1;
+      *index++ = i0 + 1;
+      *index++ = i1 + 1;
+    }
+  }
+}
+
+static void csr_bench_sort(double *values, int count)
+{
+  int i, j;
+
+  for (i = 1; i < count; ++i)
+  {
+    double value = values[i];
+
+    for (j = i; j > 0 && values[j - 1] > value; --j)
+    {
+      values[j] = values[j - 1];
+    }
+
+    values[j] = value;
+  }
+}
+
+/* Renders frames of a scene rotating once around the y axis and returns the sorted frame times in ms. */
+static int csr_bench_run(csr_bench_scene *scene, csr_bench_options *options, int width, int height, double *frame_ms)
+{
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory = malloc(memory_size);
+  csr_context context = {0};
+  float bounds[6];
+  int frame;
+
+  if (!memory || !csr_init_model(&context, memory, memory_size, width, height))
+  {
+    free(memory);
+    return 0;
+  }
+
+  csr_set_simd_level(&context, options->simd);
+
+#ifdef CSR_USE_PTHREADS
+  if (options->threads > 1 && !csr_threads_init(&context, options->threads))
+  {
+    free(memory);
+    return 0;
+  }
+#endif
+
+  csr_mesh_bounds(bounds, scene->stride, scene->vertices, scene->vertices_size);
+
+  {
+    /* Camera setup using your linear algebra library */
+    v3 look_at_pos = vm_v3_zero;
+    v3 up = vm_v3(0.0f, 1.0f, 0.0f);
+    v3 cam_position = vm_v3(0.0f, 0.0f, 3.0f);
+    float cam_fov = 60.0f;
+
+    m4x4 projection = vm_m4x4_perspective(vm_radf(cam_fov), (float)width / (float)height, 0.1f, 100.0f);
+    m4x4 view = vm_m4x4_lookAt(cam_position, look_at_pos, up);
+    m4x4 projection_view = vm_m4x4_mul(projection, view);
+
+    /* Center the mesh and scale its bounding box to a diagonal of 2 */
+    v3 center = vm_v3((bounds[0] + bounds[3]) * 0.5f, (bounds[1] + bounds[4]) * 0.5f, (bounds[2] + bounds[5]) * 0.5f);
+    v3 extent = vm_v3(bounds[3] - bounds[0], bounds[4] - bounds[1], bounds[5] - bounds[2]);
+    float scale = 2.0f / vm_sqrtf(extent.x * extent.x + extent.y * extent.y + extent.z * extent.z);
+    m4x4 fit = vm_m4x4_mul(vm_m4x4_scalef(vm_m4x4_identity, scale), vm_m4x4_translate(vm_m4x4_identity, vm_v3(-center.x, -center.y, -center.z)));
+
+    for (frame = -CSR_BENCH_WARMUP_FRAMES; frame < options->frames; ++frame)
+    {
+      m4x4 model = vm_m4x4_mul(vm_m4x4_rotate(vm_m4x4_identity, vm_radf(360.0f * (float)frame / (float)options->frames), vm_v3(0.0f, 1.0f, 0.0f)), fit);
+      m4x4 model_view_projection = vm_m4x4_mul(projection_view, model);
+      double start = perf_platform_current_time_nanoseconds();
+
+      csr_render_clear_screen(&context, clear_color);
+      csr_render_bounded(&context, CSR_RENDER_SOLID, scene->culling_mode, scene->stride, scene->vertices, scene->vertices_size, scene->indices, scene->indices_size, model_view_projection.e, bounds);
+
+      if (frame >= 0)
+      {
+        frame_ms[frame] = (perf_platform_current_time_nanoseconds() - start) / 1000000.0;
+      }
+    }
+  }
+
+#ifdef CSR_USE_PTHREADS
+  csr_threads_shutdown(&context);
+#endif
+
+  free(memory);
+
+  csr_bench_sort(frame_ms, options->frames);
+
+  return 1;
+}
+
+static void csr_bench_print(csr_bench_scene *scene, csr_bench_options *options, int width, int height, double *frame_ms, int first)
+{
+  /* Throughput of the min., median and p99 frame time, so the p99 columns describe the slow frames */
+  int percentiles[3];
+  double triangles = (double)(scene->indices_size / 3);
+  double pixels = (double)width * (double)height;
+  int i;
+
+  percentiles[0] = 0;
+  percentiles[1] = options->frames / 2;
+  percentiles[2] = (options->frames * 99 + 99) / 100 - 1;
+
+  if (options->json)
+  {
+    printf("%s    {\"scene\": \"%s\", \"width\": %d, \"height\": %d, \"triangles\": %lu, \"frames\": %d",
+           first ? "" : ",\n", scene->name, width, height, scene->indices_size / 3, options->frames);
+    printf(", \"ms\": [%.4f, %.4f, %.4f]", frame_ms[percentiles[0]], frame_ms[percentiles[1]], frame_ms[percentiles[2]]);
+    printf(", \"mtri_s\": [%.3f, %.3f, %.3f]", triangles / frame_ms[percentiles[0]] / 1000.0, triangles / frame_ms[percentiles[1]] / 1000.0, triangles / frame_ms[percentiles[2]] / 1000.0);
+    printf(", \"mpix_s\": [%.3f, %.3f, %.3f]}", pixels / frame_ms[percentiles[0]] / 1000.0, pixels / frame_ms[percentiles[1]] / 1000.0, pixels / frame_ms[percentiles[2]] / 1000.0);
+    return;
+  }
+
+  printf("%s,%s,%d,%d,%d,%d,%lu,%d", scene->name, csr_bench_simd_name(options->simd),
+#ifdef CSR_USE_SSE
+         1,
+#else
+         0,
+#endif
+         options->threads, width, height, scene->indices_size / 3, options->frames);
+
+  for (i = 0; i < 3; ++i)
+  {
+    printf(",%.4f", frame_ms[percentiles[i]]);
+  }
+
+  for (i = 0; i < 3; ++i)
+  {
+    printf(",%.3f", triangles / frame_ms[percentiles[i]] / 1000.0);
+  }
+
+  for (i = 0; i < 3; ++i)
+  {
+    printf(",%.3f", pixels / frame_ms[percentiles[i]] / 1000.0);
+  }
+
+  printf("\n");
+}
+
+/* Renders every scene at every resolution and prints one result per combination. */
+static int csr_bench_scenes(csr_bench_options *options, double *frame_ms)
+{
+  csr_bench_scene scenes[6];
+  int scene_count = 0;
+  int first = 1;
+  int s, r;
+
+  scenes[scene_count].name = "cube";
+  scenes[scene_count].culling_mode = CSR_CULLING_CCW_BACKFACE;
+  scenes[scene_count].stride = 6;
+  scenes[scene_count].vertices = cube_vertices;
+  scenes[scene_count].vertices_size = sizeof(cube_vertices) / sizeof(cube_vertices[0]);
+  scenes[scene_count].indices = cube_indices;
+  scenes[scene_count].indices_size = sizeof(cube_indices) / sizeof(cube_indices[0]);
+  scene_count++;
+
+  scenes[scene_count].name = "teddy";
+  scenes[scene_count].culling_mode = CSR_CULLING_DISABLED;
+  scenes[scene_count].stride = 3;
+  scenes[scene_count].vertices = teddy_vertices;
+  scenes[scene_count].vertices_size = teddy_vertices_size;
+  scenes[scene_count].indices = teddy_indices;
+  scenes[scene_count].indices_size = teddy_indices_size;
+  scene_count++;
+
+  scenes[scene_count].name = "head";
+  scenes[scene_count].culling_mode = CSR_CULLING_CCW_BACKFACE;
+  scenes[scene_count].stride = 3;
+  scenes[scene_count].vertices = head_vertices;
+  scenes[scene_count].vertices_size = head_vertices_size;
+  scenes[scene_count].indices = head_indices;
+  scenes[scene_count].indices_size = head_indices_size;
+  scene_count++;
+
+  if (!csr_bench_voxelize(&scenes[scene_count++], "voxel_teddy", teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, 101, 4) ||
+      !csr_bench_voxelize(&scenes[scene_count++], "voxel_head", head_vertices, head_vertices_size, head_indices, head_indices_size, 101, 2))
+  {
+    fprintf(stderr, "[mvx] voxelization failed!\n");
+    return 0;
+  }
+
+  csr_bench_sphere(&scenes[scene_count++], "sphere_1m", 1000, 500);
+
+  if (!options->json)
+  {
+    printf("scene,simd,sse,threads,width,height,triangles,frames,ms_min,ms_median,ms_p99,mtri_s_min,mtri_s_median,mtri_s_p99,mpix_s_min,mpix_s_median,mpix_s_p99\n");
+  }
+
+  for (s = 0; s < scene_count; ++s)
+  {
+    for (r = 0; r < (int)(sizeof(resolutions) / sizeof(resolutions[0])); ++r)
+    {
+      if (!csr_bench_run(&scenes[s], options, resolutions[r][0], resolutions[r][1], frame_ms))
+      {
+        fprintf(stderr, "[csr] %s at %dx%d could not be initialized\n", scenes[s].name, resolutions[r][0], resolutions[r][1]);
+        return 0;
+      }
+
+      csr_bench_print(&scenes[s], options, resolutions[r][0], resolutions[r][1], frame_ms, first);
+      first = 0;
+    }
+  }
+
+  for (s = 3; s < scene_count; ++s)
+  {
+    free(scenes[s].vertices);
+    free(scenes[s].indices);
+  }
+
+  return 1;
+}
+
+/* #############################################################################
+ * # KERNEL MICROBENCHMARKS
+ * #############################################################################
+ */
+#define CSR_BENCH_LINES 1024
+#define CSR_BENCH_VERTICES 65536
+
+/* Triangles of one size class drawn per sample, size is the length of the two legs of a right triangle in pixels */
+typedef struct csr_bench_triangle_class
+{
+  char *name;
+  float size;
+  int sliver;
+  int count;
+
+} csr_bench_triangle_class;
+
+static csr_bench_triangle_class triangle_classes[] = {
+    {"subpixel", 0.7f, 0, 4096},
+    {"10px", 10.0f, 0, 4096},
+    {"100px", 100.0f, 0, 256},
+    {"fullscreen", 0.0f, 0, 8},
+    {"sliver", 200.0f, 1, 1024}};
+
+static float bench_positions[3][CSR_BENCH_VERTICES];
+static float bench_clip[4][CSR_BENCH_VERTICES];
+static volatile float bench_sink;
+
+/* Pseudo random numbers in [0, 1), the same sequence on every run */
+static unsigned long bench_random_state = 1;
+
+static float csr_bench_randomf(void)
+{
+  bench_random_state = (bench_random_state * 1103515245UL + 12345UL) & 0x7fffffffUL;
+  return (float)(bench_random_state >> 8) / 8388608.0f;
+}
+
+/* Prints the min., median and p99 of the cycles per unit (pixel, triangle or vertex) of the measured samples. */
+static void csr_bench_print_kernel(csr_bench_options *options, char *kernel, char *unit, int width, int height, double units, double *cycles, int *first)
+{
+  int percentiles[3];
+  int i;
+
+  csr_bench_sort(cycles, options->frames);
+
+  percentiles[0] = 0;
+  percentiles[1] = options->frames / 2;
+  percentiles[2] = (options->frames * 99 + 99) / 100 - 1;
+
+  if (options->json)
+  {
+    printf("%s    {\"kernel\": \"%s\", \"unit\": \"%s\", \"width\": %d, \"height\": %d, \"units\": %.0f, \"samples\": %d, \"cycles\": [%.3f, %.3f, %.3f]}",
+           *first ? "" : ",\n", kernel, unit, width, height, units, options->frames,
+           cycles[percentiles[0]] / units, cycles[percentiles[1]] / units, cycles[percentiles[2]] / units);
+    *first = 0;
+    return;
+  }
+
+  printf("%s,%s,%d,%d,%d,%s,%.0f,%d", kernel, csr_bench_simd_name(options->simd),
+#ifdef CSR_USE_SSE
+         1,
+#else
+         0,
+#endif
+         width, height, unit, units, options->frames);
+
+  for (i = 0; i < 3; ++i)
+  {
+    printf(",%.3f", cycles[percentiles[i]] / units);
+  }
+
+  printf("\n");
+}
+
+/* Times csr_render_clear_screen and csr_render_clear_screen_fast (flags only, no pixels written) per pixel at every resolution. */
+static void csr_bench_kernel_clear(csr_bench_options *options, double *cycles, int *first)
+{
+  int r, sample, fast;
+
+  for (r = 0; r < (int)(sizeof(resolutions) / sizeof(resolutions[0])); ++r)
+  {
+    int width = resolutions[r][0];
+    int height = resolutions[r][1];
+    unsigned long memory_size = csr_memory_size(width, height);
+    void *memory = malloc(memory_size);
+    csr_context context = {0};
+
+    csr_init_model(&context, memory, memory_size, width, height);
+    csr_set_simd_level(&context, options->simd);
+
+    for (fast = 0; fast < 2; ++fast)
+    {
+      for (sample = -CSR_BENCH_WARMUP_FRAMES; sample < options->frames; ++sample)
+      {
+        unsigned long start = perf_platform_current_cycle_count();
+
+        if (fast)
+        {
+          csr_render_clear_screen_fast(&context, clear_color);
+        }
+        else
+        {
+          csr_render_clear_screen(&context, clear_color);
+        }
+
+        if (sample >= 0)
+        {
+          cycles[sample] = (double)(perf_platform_current_cycle_count() - start);
+        }
+      }
+
+      csr_bench_print_kernel(options, fast ? "clear_fast" : "clear", "pixel", width, height, (double)width * (double)height, cycles, first);
+    }
+
+    free(memory);
+  }
+}
+
+/* Times csr_draw_line per pixel with 100 pixel long lines in random directions, every line in front of the last. */
+static void csr_bench_kernel_line(csr_context *context, csr_bench_options *options, double *cycles, int *first)
+{
+  static float points[CSR_BENCH_LINES][2][3];
+  csr_color color = csr_init_color(255, 255, 255);
+  double pixels = 0.0;
+  int i, sample;
+
+  for (i = 0; i < CSR_BENCH_LINES; ++i)
+  {
+    float angle = vm_radf(360.0f * csr_bench_randomf());
+    float z = 0.99f - 0.98f * (float)i / (float)CSR_BENCH_LINES;
+
+    points[i][0][0] = 100.0f + csr_bench_randomf() * (float)(context->width - 200);
+    points[i][0][1] = 100.0f + csr_bench_randomf() * (float)(context->height - 200);
+    points[i][1][0] = points[i][0][0] + 100.0f * vm_cosf(angle);
+    points[i][1][1] = points[i][0][1] + 100.0f * vm_sinf(angle);
+    points[i][0][2] = z;
+    points[i][1][2] = z;
+
+    /* The line steps once per pixel along its major axis */
+    pixels += (double)(csr_maxi(csr_absi((int)points[i][1][0] - (int)points[i][0][0]), csr_absi((int)points[i][1][1] - (int)points[i][0][1])) + 1);
+  }
+
+  for (sample = -CSR_BENCH_WARMUP_FRAMES; sample < options->frames; ++sample)
+  {
+    unsigned long start;
+
+    csr_render_clear_screen(context, clear_color);
+
+    start = perf_platform_current_cycle_count();
+
+    for (i = 0; i < CSR_BENCH_LINES; ++i)
+    {
+      csr_draw_line(context, points[i][0], points[i][1], color);
+    }
+
+    if (sample >= 0)
+    {
+      cycles[sample] = (double)(perf_platform_current_cycle_count() - start);
+    }
+  }
+
+  csr_bench_print_kernel(options, "line", "pixel", context->width, context->height, pixels, cycles, first);
+}
+
+/* Times csr_draw_triangle (setup and rasterization) per triangle and per pixel for a size class. Every triangle is
+ * in front of the previous ones, so all covered pixels pass the depth test.
+ */
+static void csr_bench_kernel_triangle(csr_context *context, csr_bench_options *options, csr_bench_triangle_class *triangle_class, double *cycles, int *first)
+{
+  float *points = (float *)malloc((unsigned long)triangle_class->count * 9 * sizeof(float));
+  csr_color c0 = csr_init_color(255, 50, 50);
+  csr_color c1 = csr_init_color(50, 255, 50);
+  csr_color c2 = csr_init_color(50, 50, 255);
+  float width = (float)context->width;
+  float height = (float)context->height;
+  double pixels = 0.0;
+  char name[64];
+  int i, sample;
+
+  for (i = 0; i < triangle_class->count; ++i)
+  {
+    float *p = &points[i * 9];
+    float size = triangle_class->size;
+    float angle = vm_radf(360.0f * csr_bench_randomf());
+    float x = size + csr_bench_randomf() * (width - 2.0f * size);
+    float y = size + csr_bench_randomf() * (height - 2.0f * size);
+    float leg = triangle_class->sliver ? 1.0f : size;
+
+    if (size == 0.0f)
+    {
+      /* Covers the whole screen */
+      p[0] = 0.0f, p[1] = 0.0f;
+      p[3] = 2.0f * width, p[4] = 0.0f;
+      p[6] = 0.0f, p[7] = 2.0f * height;
+    }
+    else
+    {
+      p[0] = x, p[1] = y;
+      p[3] = x + size * vm_cosf(angle), p[4] = y + size * vm_sinf(angle);
+      p[6] = x - leg * vm_sinf(angle), p[7] = y + leg * vm_cosf(angle);
+    }
+
+    p[2] = p[5] = p[8] = 0.99f - 0.98f * (float)i / (float)triangle_class->count;
+  }
+
+  for (sample = -CSR_BENCH_WARMUP_FRAMES; sample < options->frames; ++sample)
+  {
+    unsigned long start, end;
+
+    csr_render_clear_screen(context, clear_color);
+    csr_occlusion_query_begin(context);
+
+    start = perf_platform_current_cycle_count();
+
+    for (i = 0; i < triangle_class->count; ++i)
+    {
+      csr_draw_triangle(context, &points[i * 9], &points[i * 9 + 3], &points[i * 9 + 6], c0, c1, c2);
+    }
+
+    end = perf_platform_current_cycle_count();
+
+    pixels = (double)csr_occlusion_query_end(context);
+
+    if (sample >= 0)
+    {
+      cycles[sample] = (double)(end - start);
+    }
+  }
+
+  sprintf(name, "triangle_%s", triangle_class->name);
+  csr_bench_print_kernel(options, name, "triangle", context->width, context->height, (double)triangle_class->count, cycles, first);
+
+  /* The samples are sorted now, dividing by the pixels instead of the triangles keeps the order */
+  if (pixels > 0.0)
+  {
+    csr_bench_print_kernel(options, name, "pixel", context->width, context->height, pixels, cycles, first);
+  }
+
+  free(points);
+}
+
+/* Times csr_m4x4_mul_v4 and the selected transform kernel per vertex. */
+static void csr_bench_kernel_transform(csr_context *context, csr_bench_options *options, double *cycles, int *first)
+{
+  float *positions[3];
+  float *clip[4];
+  m4x4 projection = vm_m4x4_perspective(vm_radf(60.0f), (float)context->width / (float)context->height, 0.1f, 100.0f);
+  m4x4 view = vm_m4x4_lookAt(vm_v3(1.0f, 2.0f, 3.0f), vm_v3_zero, vm_v3(0.0f, 1.0f, 0.0f));
+  m4x4 m = vm_m4x4_mul(projection, view);
+  int i, sample;
+
+  for (i = 0; i < CSR_BENCH_VERTICES; ++i)
+  {
+    bench_positions[0][i] = csr_bench_randomf() - 0.5f;
+    bench_positions[1][i] = csr_bench_randomf() - 0.5f;
+    bench_positions[2][i] = csr_bench_randomf() - 0.5f;
+  }
+
+  for (i = 0; i < 3; ++i)
+  {
+    positions[i] = bench_positions[i];
+  }
+
+  for (i = 0; i < 4; ++i)
+  {
+    clip[i] = bench_clip[i];
+  }
+
+  for (sample = -CSR_BENCH_WARMUP_FRAMES; sample < options->frames; ++sample)
+  {
+    unsigned long start = perf_platform_current_cycle_count();
+    float sum = 0.0f;
+
+    for (i = 0; i < CSR_BENCH_VERTICES; ++i)
+    {
+      float v[4];
+      float result[4];
+
+      csr_pos_init(v, bench_positions[0][i], bench_positions[1][i], bench_positions[2][i], 1.0f);
+      csr_m4x4_mul_v4(result, m.e, v);
+      sum += result[3];
+    }
+
+    bench_sink = sum;
+
+    if (sample >= 0)
+    {
+      cycles[sample] = (double)(perf_platform_current_cycle_count() - start);
+    }
+  }
+
+  csr_bench_print_kernel(options, "m4x4_mul_v4", "vertex", context->width, context->height, (double)CSR_BENCH_VERTICES, cycles, first);
+
+  for (sample = -CSR_BENCH_WARMUP_FRAMES; sample < options->frames; ++sample)
+  {
+    unsigned long start = perf_platform_current_cycle_count();
+
+    context->kernels.transform(m.e, positions, clip, CSR_BENCH_VERTICES);
+
+    if (sample >= 0)
+    {
+      cycles[sample] = (double)(perf_platform_current_cycle_count() - start);
+    }
+  }
+
+  bench_sink = bench_clip[3][CSR_BENCH_VERTICES - 1];
+
+  csr_bench_print_kernel(options, "transform", "vertex", context->width, context->height, (double)CSR_BENCH_VERTICES, cycles, first);
+}
+
+/* Runs the kernel microbenchmarks on the calling thread, lines, triangles and transforms at 1920x1080. */
+static int csr_bench_kernels(csr_bench_options *options, double *cycles)
+{
+  int width = 1920;
+  int height = 1080;
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory = malloc(memory_size);
+  csr_context context = {0};
+  int first = 1;
+  int c;
+
+  if (!memory || !csr_init_model(&context, memory, memory_size, width, height))
+  {
+    free(memory);
+    return 0;
+  }
+
+  csr_set_simd_level(&context, options->simd);
+
+  if (!options->json)
+  {
+    printf("kernel,simd,sse,width,height,unit,units,samples,cycles_min,cycles_median,cycles_p99\n");
+  }
+
+  csr_bench_kernel_clear(options, cycles, &first);
+  csr_bench_kernel_line(&context, options, cycles, &first);
+
+  for (c = 0; c < (int)(sizeof(triangle_classes) / sizeof(triangle_classes[0])); ++c)
+  {
+    csr_bench_kernel_triangle(&context, options, &triangle_classes[c], cycles, &first);
+  }
+
+  csr_bench_kernel_transform(&context, options, cycles, &first);
+
+  free(memory);
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  csr_bench_options options;
+  double *samples;
+  int kernels = 0;
+  int result;
+  int i;
+
+  options.frames = 50;
+  options.threads = 1;
+  options.simd = csr_cpu_simd_level();
+  options.json = 0;
+
+  for (i = 1; i + 1 < argc; i += 2)
+  {
+    if (strcmp(argv[i], "--frames") == 0)
+    {
+      options.frames = atoi(argv[i + 1]);
+    }
+    else if (strcmp(argv[i], "--threads") == 0)
+    {
+      options.threads = atoi(argv[i + 1]);
+    }
+    else if (strcmp(argv[i], "--simd") == 0)
+    {
+      options.simd = strcmp(argv[i + 1], "avx2") == 0 ? CSR_SIMD_AVX2 : (strcmp(argv[i + 1], "sse2") == 0 ? CSR_SIMD_SSE2 : CSR_SIMD_SCALAR);
+    }
+    else if (strcmp(argv[i], "--format") == 0)
+    {
+      options.json = strcmp(argv[i + 1], "json") == 0;
+    }
+    else if (strcmp(argv[i], "--suite") == 0)
+    {
+      kernels = strcmp(argv[i + 1], "kernels") == 0;
+    }
+  }
+
+  if (options.frames < 1 || options.frames > CSR_BENCH_FRAMES_MAX)
+  {
+    fprintf(stderr, "[csr] --frames must be between 1 and %d\n", CSR_BENCH_FRAMES_MAX);
+    return 1;
+  }
+
+#ifdef CSR_USE_PTHREADS
+  options.threads = options.threads < 1 ? 1 : (options.threads > CSR_THREADS_MAX ? CSR_THREADS_MAX : options.threads);
+#else
+  options.threads = 1;
+#endif
+
+  /* The kernels are timed on the calling thread */
+  if (kernels)
+  {
+    options.threads = 1;
+  }
+
+  /* The SIMD level actually used: the requested one if it is compiled in and supported by the CPU */
+  {
+    csr_context probe = {0};
+    unsigned long memory_size = csr_memory_size_buffers(1, 1);
+    void *memory = malloc(memory_size);
+
+    csr_init_model(&probe, memory, memory_size, 1, 1);
+    options.simd = csr_set_simd_level(&probe, options.simd);
+    free(memory);
+  }
+
+  samples = (double *)malloc((unsigned long)options.frames * sizeof(double));
+
+  if (options.json)
+  {
+    printf("{\n  \"config\": {\"suite\": \"%s\", \"simd\": \"%s\", \"sse\": %s, \"avx2\": %s, \"threads\": %d, \"frames\": %d},\n  \"results\": [\n",
+           kernels ? "kernels" : "scenes", csr_bench_simd_name(options.simd),
+#ifdef CSR_USE_SSE
+           "true",
+#else
+           "false",
+#endif
+#ifdef CSR_HAS_AVX2
+           "true",
+#else
+           "false",
+#endif
+           options.threads, options.frames);
+  }
+
+  result = kernels ? csr_bench_kernels(&options, samples) : csr_bench_scenes(&options, samples);
+
+  if (options.json)
+  {
+    printf("\n  ]\n}\n");
+  }
+
+  free(samples);
+
+  return result ? 0 : 1;
+}
+
+/*
+   ------------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+   WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+   ------------------------------------------------------------------------------
+*/
@@ -10,11 +10,17 @@ LICENSE
 */
 #include <stdio.h>        /* Testing only: write ppm file                                        */
 #include <stdlib.h>       /* Testing only: malloc/free                                           */
+#include <string.h>       /* Testing only: memcmp                                                */
 #define CSR_USE_SSE       /* Enable SIMD SSE                                                     */
+#define CSR_ENABLE_TIMINGS /* Cycles per pipeline stage (only counted if a timer is set)          */
 #include "../csr.h"       /* C Software Renderer                                                 */
 #include "../deps/vm.h"   /* Linear Algebra Math Library (you can use any library that you want) */
+#if defined(CSR_USE_PTHREADS) && defined(_STRUCT_TIMESPEC)
+#define __timespec_defined /* struct timespec is already declared by pthread.h                   */
+#endif
 #include "../deps/perf.h" /* Simple Performance Profiler                                         */
 #include "../deps/mvx.h"  /* Mesh Voxelizer                                                      */
+#include "../deps/test.h" /* Simple Testing Framework                                            */
 #include "tools/teddy.h"  /* Teddy OBJ file converted to C89 arrays                              */
 #include "tools/head.h"   /* Head OBJ file                                                       */
 
@@ -53,7 +59,7 @@ static csr_color clear_color = {40, 40, 40};
  * @param filename The name of the output file.
  * @param framebuffer The framebuffer to save.
  */
-static void csr_save_ppm(char *filename_format, int frame, csr_context *model)
+static void csr_save_ppm_image(char *filename_format, int frame, int width, int height, csr_color *pixels)
 {
   FILE *fp;
   char filename[64];
@@ -70,14 +76,118 @@ static void csr_save_ppm(char *filename_format, int frame, csr_context *model)
   }
 
   /* PPM header */
-  fprintf(fp, "P6\n%d %d\n255\n", model->width, model->height);
+  fprintf(fp, "P6\n%d %d\n255\n", width, height);
 
   /* Pixel data */
-  fwrite(model->framebuffer, sizeof(csr_color), (size_t)(model->width * model->height), fp);
+  fwrite(pixels, sizeof(csr_color), (size_t)(width * height), fp);
 
   fclose(fp);
 }
 
+static void csr_save_ppm(char *filename_format, int frame, csr_context *model)
+{
+  csr_save_ppm_image(filename_format, frame, model->width, model->height, model->framebuffer);
+}
+
+/* Projection view matrix of a camera at 0, 0, cam_z looking at the origin */
+static m4x4 csr_test_projection_view(int width, int height, float cam_z)
+{
+  m4x4 projection = vm_m4x4_perspective(vm_radf(90.0f), (float)width / (float)height, 0.1f, 1000.0f);
+  m4x4 view = vm_m4x4_lookAt(vm_v3(0.0f, 0.0f, cam_z), vm_v3_zero, vm_v3(0.0f, 1.0f, 0.0f));
+
+  return vm_m4x4_mul(projection, view);
+}
+
+/* Returns 1 if both contexts hold the same colors and depths */
+static int csr_test_same_image(csr_context *a, csr_context *b)
+{
+  size_t pixels = (size_t)(a->width * a->height);
+
+  return a->width == b->width && a->height == b->height &&
+         memcmp(a->framebuffer, b->framebuffer, pixels * sizeof(csr_color)) == 0 &&
+         memcmp(a->zbuffer, b->zbuffer, pixels * sizeof(float)) == 0;
+}
+
+/* Records a 16 x 16 x 8 grid of cubes rotated by parent into buffer. matrices receives the projection view model
+ * matrix of every draw. Returns the number of recorded draws.
+ */
+static unsigned long csr_test_record_grid(csr_command_buffer *buffer, m4x4 projection_view, transformation *parent, float *matrices)
+{
+  unsigned long draw = 0;
+  int x, y, z, i;
+
+  for (z = 0; z < 8; ++z)
+  {
+    for (y = 0; y < 16; ++y)
+    {
+      for (x = 0; x < 16; ++x)
+      {
+        transformation child = vm_transformation_init();
+        m4x4 model_view_projection;
+
+        child.position = vm_v3((float)x - 8.0f, (float)y - 8.0f, (float)z * 2.0f - 8.0f);
+        child.scale = vm_v3(0.9f, 0.9f, 0.9f);
+        child.parent = parent;
+
+        model_view_projection = vm_m4x4_mul(projection_view, vm_transformation_matrix(&child));
+
+        for (i = 0; i < 16; ++i)
+        {
+          matrices[draw * 16 + (unsigned long)i] = model_view_projection.e[i];
+        }
+
+        assert(csr_record_render(buffer, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, &matrices[draw * 16]));
+
+        ++draw;
+      }
+    }
+  }
+
+  return draw;
+}
+
+static void csr_test_fill_rule(void)
+{
+  /* Two triangles sharing a diagonal that passes exactly through pixel centers */
+  float p0[3] = {2.5f, 3.5f, 0.5f};
+  float p1[3] = {10.5f, 3.5f, 0.5f};
+  float p2[3] = {10.5f, 9.5f, 0.5f};
+  float p3[3] = {2.5f, 9.5f, 0.5f};
+
+  csr_color white = {255, 255, 255};
+
+  unsigned char memory_first[16 * 16 * (sizeof(csr_color) + sizeof(float))];
+  unsigned char memory_second[16 * 16 * (sizeof(csr_color) + sizeof(float))];
+
+  csr_context first = {0};
+  csr_context second = {0};
+
+  int covered_first = 0;
+  int covered_second = 0;
+  int covered_both = 0;
+  int i;
+
+  assert(csr_init_model(&first, memory_first, sizeof(memory_first), 16, 16));
+  assert(csr_init_model(&second, memory_second, sizeof(memory_second), 16, 16));
+
+  csr_render_clear_screen(&first, clear_color);
+  csr_render_clear_screen(&second, clear_color);
+
+  csr_draw_triangle(&first, p0, p1, p2, white, white, white);
+  csr_draw_triangle(&second, p0, p2, p3, white, white, white);
+
+  for (i = 0; i < 16 * 16; ++i)
+  {
+    covered_first += first.zbuffer[i] < 1.0f;
+    covered_second += second.zbuffer[i] < 1.0f;
+    covered_both += first.zbuffer[i] < 1.0f && second.zbuffer[i] < 1.0f;
+  }
+
+  /* The 8x6 pixel quad is covered without gaps and no pixel on the shared edge is drawn twice */
+  assert(covered_first + covered_second == 8 * 6);
+  assert(covered_both == 0);
+}
+
 static void csr_test_stack_alloc(void)
 {
 /* Define the render area */
@@ -469,14 +579,1711 @@ void csr_test_voxelize_head(void)
   free(voxels);
 }
 
+static void csr_test_simd_levels(void)
+{
+  int width = 800;
+  int height = 600;
+
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory_scalar = malloc(memory_size);
+  void *memory_simd = malloc(memory_size);
+
+  csr_context scalar = {0};
+  csr_context simd = {0};
+
+  int level;
+
+  if (!csr_init_model(&scalar, memory_scalar, memory_size, width, height) ||
+      !csr_init_model(&simd, memory_simd, memory_size, width, height))
+  {
+    return;
+  }
+
+  assert(csr_set_simd_level(&scalar, CSR_SIMD_SCALAR) == CSR_SIMD_SCALAR);
+
+  for (level = CSR_SIMD_SSE2; level <= CSR_SIMD_AVX2; ++level)
+  {
+    /* Skip levels that are not compiled in or not supported by this CPU */
+    if (csr_set_simd_level(&simd, (csr_simd_level)level) != (csr_simd_level)level)
+    {
+      continue;
+    }
+
+    {
+      m4x4 projection_view = csr_test_projection_view(width, height, 50.0f);
+
+      v3 rotation_axis = vm_v3(0.5f, 1.0f, 0.0);
+      m4x4 model_base = vm_m4x4_translate(vm_m4x4_identity, vm_v3_zero);
+
+      int frame;
+
+      for (frame = 0; frame < 10; ++frame)
+      {
+        m4x4 model = vm_m4x4_rotate(model_base, vm_radf(5.0f * (float)(frame + 1)), rotation_axis);
+        m4x4 model_view_projection = vm_m4x4_mul(projection_view, model);
+        m4x4 cube_model_view_projection = vm_m4x4_mul(projection_view, vm_m4x4_scale(model, vm_v3(40.0f, 40.0f, 40.0f)));
+
+        csr_render_clear_screen(&scalar, clear_color);
+        csr_render_clear_screen(&simd, clear_color);
+
+        PERF_PROFILE_WITH_NAME({ csr_render(&scalar, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, model_view_projection.e); }, "csr_render_scalar");
+        PERF_PROFILE_WITH_NAME({ csr_render(&simd, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, model_view_projection.e); }, level == CSR_SIMD_AVX2 ? "csr_render_avx2" : "csr_render_sse2");
+
+        /* A large cube in front of the teddy covers whole tiles */
+        csr_render(&scalar, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, cube_model_view_projection.e);
+        csr_render(&simd, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, cube_model_view_projection.e);
+
+        /* Every kernel variant must produce the same image as the scalar one */
+        assert(csr_test_same_image(&scalar, &simd));
+      }
+    }
+  }
+
+  free(memory_scalar);
+  free(memory_simd);
+}
+
+static void csr_test_hierarchical_depth(void)
+{
+  int width = 800;
+  int height = 600;
+
+  /* Without binning memory there is no hierarchical depth buffer and every pixel is depth tested */
+  unsigned long memory_size_plain = csr_memory_size_buffers(width, height);
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory_plain = malloc(memory_size_plain);
+  void *memory = malloc(memory_size);
+
+  csr_context plain = {0};
+  csr_context context = {0};
+
+  if (!csr_init_model(&plain, memory_plain, memory_size_plain, width, height) ||
+      !csr_init_model(&context, memory, memory_size, width, height))
+  {
+    return;
+  }
+
+  assert(plain.hiz == 0);
+  assert(context.hiz != 0);
+
+  {
+    m4x4 projection_view = csr_test_projection_view(width, height, 50.0f);
+
+    v3 rotation_axis = vm_v3(0.5f, 1.0f, 0.0);
+    m4x4 model_base = vm_m4x4_translate(vm_m4x4_identity, vm_v3_zero);
+
+    int frame;
+
+    for (frame = 0; frame < 10; ++frame)
+    {
+      m4x4 model = vm_m4x4_rotate(model_base, vm_radf(5.0f * (float)(frame + 1)), rotation_axis);
+      m4x4 model_view_projection = vm_m4x4_mul(projection_view, model);
+      m4x4 wall = vm_m4x4_translate(vm_m4x4_identity, vm_v3(10.0f * (float)(frame - 5), 0.0f, 20.0f));
+      m4x4 wall_model_view_projection = vm_m4x4_mul(projection_view, vm_m4x4_scale(wall, vm_v3(30.0f, 30.0f, 1.0f)));
+
+      csr_render_clear_screen(&plain, clear_color);
+      csr_render_clear_screen(&context, clear_color);
+
+      /* A wall partially hiding the teddy is drawn first, so the teddy behind it is rejected early */
+      csr_render(&plain, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, wall_model_view_projection.e);
+      csr_render(&context, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, wall_model_view_projection.e);
+
+      PERF_PROFILE_WITH_NAME({ csr_render(&plain, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, model_view_projection.e); }, "csr_render_occluded");
+      PERF_PROFILE_WITH_NAME({ csr_render(&context, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, model_view_projection.e); }, "csr_render_occluded_hiz");
+
+      /* Rejecting hidden tiles and blocks must not change the image */
+      assert(csr_test_same_image(&plain, &context));
+    }
+  }
+
+  free(memory_plain);
+  free(memory);
+}
+
+static void csr_test_depth_prepass(void)
+{
+  int width = 800;
+  int height = 600;
+
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory_direct = malloc(memory_size);
+  void *memory_prepass = malloc(memory_size);
+
+  csr_context direct = {0};
+  csr_context prepass = {0};
+
+  if (!csr_init_model(&direct, memory_direct, memory_size, width, height) ||
+      !csr_init_model(&prepass, memory_prepass, memory_size, width, height))
+  {
+    return;
+  }
+
+  {
+    m4x4 projection_view = csr_test_projection_view(width, height, 50.0f);
+
+    v3 rotation_axis = vm_v3(0.5f, 1.0f, 0.0);
+    m4x4 model_base = vm_m4x4_translate(vm_m4x4_identity, vm_v3_zero);
+
+    int frame, pass, x, y, z;
+
+    for (frame = 0; frame < 10; ++frame)
+    {
+      m4x4 model = vm_m4x4_rotate(model_base, vm_radf(5.0f * (float)(frame + 1)), rotation_axis);
+      m4x4 model_view_projection = vm_m4x4_mul(projection_view, model);
+
+      csr_render_clear_screen(&direct, clear_color);
+      csr_render_clear_screen(&prepass, clear_color);
+
+      /* The same scene is drawn once directly and twice (depth, then color) in the prepass context */
+      for (pass = 0; pass < 3; ++pass)
+      {
+        csr_context *context = pass == 0 ? &direct : &prepass;
+        csr_render_mode mode = pass == 0 ? CSR_RENDER_SOLID : (pass == 1 ? CSR_RENDER_DEPTH_ONLY : CSR_RENDER_DEPTH_EQUAL);
+
+        PERF_PROFILE_WITH_NAME({
+          /* Layers of rotating (not intersecting) cubes in front of the teddy give a high depth complexity */
+          for (z = 0; z < 4; ++z)
+          {
+            for (y = -4; y < 4; ++y)
+            {
+              for (x = -5; x < 5; ++x)
+              {
+                m4x4 cube = vm_m4x4_translate(vm_m4x4_identity, vm_v3(4.0f * (float)x + 2.0f, 4.0f * (float)y + 2.0f, 4.0f * (float)z + 20.0f));
+                m4x4 cube_model_view_projection = vm_m4x4_mul(projection_view, vm_m4x4_rotate(vm_m4x4_scale(cube, vm_v3(2.0f, 2.0f, 2.0f)), vm_radf(5.0f * (float)(frame + z)), rotation_axis));
+
+                csr_render(context, mode, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, cube_model_view_projection.e);
+              }
+            }
+          }
+
+          csr_render(context, mode, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, model_view_projection.e);
+        }, pass == 0 ? "csr_render_direct" : (pass == 1 ? "csr_render_prepass_depth" : "csr_render_prepass_color"));
+      }
+
+      /* The color pass must reproduce the depth of the prepass exactly */
+      assert(csr_test_same_image(&direct, &prepass));
+    }
+  }
+
+  free(memory_direct);
+  free(memory_prepass);
+}
+
+static void csr_test_instanced(void)
+{
+  int width = 800;
+  int height = 600;
+
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory_single = malloc(memory_size);
+  void *memory_instanced = malloc(memory_size);
+
+  /* A 24 x 24 x 8 grid of voxel cubes, one projection view model matrix per cube */
+  unsigned long instance_count = 24 * 24 * 8;
+  float *matrices = (float *)malloc(instance_count * 16 * sizeof(float));
+
+  csr_context single = {0};
+  csr_context instanced = {0};
+
+  if (!matrices ||
+      !csr_init_model(&single, memory_single, memory_size, width, height) ||
+      !csr_init_model(&instanced, memory_instanced, memory_size, width, height))
+  {
+    return;
+  }
+
+  {
+    m4x4 projection_view = csr_test_projection_view(width, height, 30.0f);
+
+    int frame, x, y, z, i;
+
+    for (frame = 0; frame < 10; ++frame)
+    {
+      transformation parent = vm_transformation_init();
+      unsigned long instance = 0;
+
+      vm_tranformation_rotate(&parent, vm_v3(0.0f, 1.0f, 0.0f), vm_radf(5.0f * (float)(frame + 1)));
+
+      for (z = 0; z < 8; ++z)
+      {
+        for (y = 0; y < 24; ++y)
+        {
+          for (x = 0; x < 24; ++x)
+          {
+            transformation child = vm_transformation_init();
+            m4x4 model_view_projection;
+
+            child.position = vm_v3((float)x - 12.0f, (float)y - 12.0f, (float)z - 4.0f);
+            child.scale = vm_v3(0.9f, 0.9f, 0.9f);
+            child.parent = &parent;
+
+            model_view_projection = vm_m4x4_mul(projection_view, vm_transformation_matrix(&child));
+
+            for (i = 0; i < 16; ++i)
+            {
+              matrices[instance * 16 + (unsigned long)i] = model_view_projection.e[i];
+            }
+
+            ++instance;
+          }
+        }
+      }
+
+      csr_render_clear_screen(&single, clear_color);
+      csr_render_clear_screen(&instanced, clear_color);
+
+      PERF_PROFILE_WITH_NAME({
+        for (instance = 0; instance < instance_count; ++instance)
+        {
+          csr_render(&single, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, &matrices[instance * 16]);
+        }
+      }, "csr_render_per_instance");
+
+      PERF_PROFILE_WITH_NAME({ csr_render_instanced(&instanced, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, matrices, instance_count); }, "csr_render_instanced");
+
+      /* Instanced rendering must match rendering the instances one by one */
+      assert(csr_test_same_image(&single, &instanced));
+    }
+  }
+
+  free(memory_single);
+  free(memory_instanced);
+  free(matrices);
+}
+
+static void csr_test_command_buffer(void)
+{
+  int width = 800;
+  int height = 600;
+
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory_direct = malloc(memory_size);
+  void *memory_recorded = malloc(memory_size);
+
+  /* A 16 x 16 x 8 grid of voxel cubes recorded back to front */
+  unsigned long draw_count = 16 * 16 * 8;
+  unsigned long command_memory_size = csr_command_buffer_memory_size(draw_count);
+  void *command_memory = malloc(command_memory_size);
+  float *matrices = (float *)malloc(draw_count * 16 * sizeof(float));
+
+  csr_context direct = {0};
+  csr_context recorded = {0};
+  csr_command_buffer buffer;
+
+  if (!command_memory || !matrices ||
+      !csr_init_model(&direct, memory_direct, memory_size, width, height) ||
+      !csr_init_model(&recorded, memory_recorded, memory_size, width, height) ||
+      !csr_command_buffer_init(&buffer, command_memory, command_memory_size))
+  {
+    return;
+  }
+
+  assert(buffer.capacity == draw_count);
+
+  {
+    m4x4 projection_view = csr_test_projection_view(width, height, 30.0f);
+
+    int frame;
+
+    for (frame = 0; frame < 10; ++frame)
+    {
+      transformation parent = vm_transformation_init();
+      unsigned long draw = 0;
+      int sorted = 1;
+
+      vm_tranformation_rotate(&parent, vm_v3(1.0f, 1.0f, 0.0f), vm_radf(5.0f * (float)(frame + 1)));
+
+      csr_command_buffer_reset(&buffer);
+
+      assert(csr_test_record_grid(&buffer, projection_view, &parent, matrices) == draw_count);
+
+      /* Recording into a full buffer fails */
+      assert(!csr_record_render(&buffer, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, matrices));
+
+      csr_render_clear_screen(&direct, clear_color);
+      csr_render_clear_screen(&recorded, clear_color);
+
+      PERF_PROFILE_WITH_NAME({
+        for (draw = 0; draw < draw_count; ++draw)
+        {
+          csr_render(&direct, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, &matrices[draw * 16]);
+        }
+      }, "csr_render_back_to_front");
+
+      PERF_PROFILE_WITH_NAME({ csr_execute(&recorded, &buffer); }, "csr_execute");
+
+      csr_render_clear_screen(&direct, clear_color);
+
+      /* Executing must match rendering the draws one by one in the sorted order, which is front to back */
+      for (draw = 0; draw < draw_count; ++draw)
+      {
+        unsigned long command = buffer.order[draw];
+
+        sorted = sorted && (draw == 0 || buffer.commands[buffer.order[draw - 1]].depth <= buffer.commands[command].depth);
+
+        csr_render(&direct, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, &matrices[command * 16]);
+      }
+
+      assert(sorted);
+      assert(csr_test_same_image(&direct, &recorded));
+
+      csr_save_ppm("command_buffer_%05d.ppm", frame, &recorded);
+    }
+
+    {
+      /* Static geometry: the vertices are already in world space and every draw uses the same matrix */
+      float *world = (float *)malloc(3 * vertices_size * sizeof(float));
+      unsigned long v;
+      int mesh;
+
+      if (!world)
+      {
+        return;
+      }
+
+      csr_command_buffer_reset(&buffer);
+
+      /* Recorded back to front */
+      for (mesh = 0; mesh < 3; ++mesh)
+      {
+        float *mesh_vertices = &world[(unsigned long)mesh * vertices_size];
+
+        for (v = 0; v < vertices_size; ++v)
+        {
+          mesh_vertices[v] = vertices[v] * 4.0f;
+
+          if (v % 6 == 2)
+          {
+            mesh_vertices[v] += 10.0f * (float)(mesh - 1);
+          }
+          else if (v % 6 >= 3)
+          {
+            mesh_vertices[v] = vertices[v];
+          }
+        }
+
+        assert(csr_record_render(&buffer, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 6, mesh_vertices, vertices_size, indices, indices_size, projection_view.e));
+      }
+
+      csr_render_clear_screen(&recorded, clear_color);
+      csr_execute(&recorded, &buffer);
+
+      /* The mesh nearest to the camera is drawn first */
+      assert(buffer.order[0] == 2 && buffer.order[1] == 1 && buffer.order[2] == 0);
+      assert(buffer.commands[2].depth < buffer.commands[1].depth && buffer.commands[1].depth < buffer.commands[0].depth);
+
+      free(world);
+    }
+  }
+
+  free(memory_direct);
+  free(memory_recorded);
+  free(command_memory);
+  free(matrices);
+}
+
+static void csr_test_visibility_buffer(void)
+{
+  int width = 800;
+  int height = 600;
+
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory_forward = malloc(memory_size);
+  void *memory_visibility = malloc(memory_size);
+
+  /* A 16 x 16 x 8 grid of voxel cubes recorded back to front with a wireframe teddy in the middle */
+  unsigned long draw_count = 16 * 16 * 8 + 1;
+  unsigned long command_memory_size = csr_command_buffer_memory_size(draw_count);
+  void *command_memory = malloc(command_memory_size);
+  float *matrices = (float *)malloc(draw_count * 16 * sizeof(float));
+
+  csr_context forward = {0};
+  csr_context visibility = {0};
+  csr_command_buffer buffer;
+
+  int level;
+
+  if (!command_memory || !matrices ||
+      !csr_init_model(&forward, memory_forward, memory_size, width, height) ||
+      !csr_init_model(&visibility, memory_visibility, memory_size, width, height) ||
+      !csr_command_buffer_init(&buffer, command_memory, command_memory_size))
+  {
+    return;
+  }
+
+  for (level = CSR_SIMD_SCALAR; level <= CSR_SIMD_AVX2; ++level)
+  {
+    /* Skip levels that are not compiled in or not supported by this CPU */
+    if (csr_set_simd_level(&forward, (csr_simd_level)level) != (csr_simd_level)level ||
+        csr_set_simd_level(&visibility, (csr_simd_level)level) != (csr_simd_level)level)
+    {
+      continue;
+    }
+
+    {
+      m4x4 projection_view = csr_test_projection_view(width, height, 30.0f);
+
+      int frame, i;
+
+      for (frame = 0; frame < 4; ++frame)
+      {
+        transformation parent = vm_transformation_init();
+        m4x4 teddy_view_projection;
+        unsigned long draw = 0, covered = 0;
+        int difference = 0;
+
+        vm_tranformation_rotate(&parent, vm_v3(1.0f, 1.0f, 0.0f), vm_radf(10.0f * (float)(frame + 1)));
+
+        csr_command_buffer_reset(&buffer);
+
+        draw = csr_test_record_grid(&buffer, projection_view, &parent, matrices);
+
+        teddy_view_projection = vm_m4x4_mul(projection_view, vm_m4x4_scalef(vm_m4x4_translate(vm_m4x4_identity, vm_v3(0.0f, 0.0f, 12.0f)), 0.3f));
+
+        for (i = 0; i < 16; ++i)
+        {
+          matrices[draw * 16 + (unsigned long)i] = teddy_view_projection.e[i];
+        }
+
+        assert(csr_record_render(&buffer, CSR_RENDER_WIREFRAME, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, &matrices[draw * 16]));
+
+        csr_render_clear_screen(&forward, clear_color);
+        csr_render_clear_screen(&visibility, clear_color);
+
+        PERF_PROFILE_WITH_NAME({ csr_execute(&forward, &buffer); }, "csr_execute");
+        PERF_PROFILE_WITH_NAME({ assert(csr_execute_visibility(&visibility, &buffer)); }, "csr_execute_visibility");
+
+        /* The visibility pass finds the same nearest triangles, the resolve pass interpolates the colors at the
+         * pixel centers directly instead of stepping them, which may round to a different integer
+         */
+        assert(memcmp(forward.zbuffer, visibility.zbuffer, (size_t)(width * height) * sizeof(float)) == 0);
+
+        for (i = 0; i < width * height; ++i)
+        {
+          unsigned int id = visibility.visibility[i];
+
+          difference = csr_maxi(difference, csr_absi((int)forward.framebuffer[i].r - (int)visibility.framebuffer[i].r));
+          difference = csr_maxi(difference, csr_absi((int)forward.framebuffer[i].g - (int)visibility.framebuffer[i].g));
+          difference = csr_maxi(difference, csr_absi((int)forward.framebuffer[i].b - (int)visibility.framebuffer[i].b));
+
+          /* Covered pixels hold the id of a cube triangle (unless a line was drawn there) */
+          if (id != CSR_VISIBILITY_EMPTY)
+          {
+            assert((id >> CSR_VISIBILITY_TRIANGLE_BITS) < draw_count - 1);
+            assert((id & ((1U << CSR_VISIBILITY_TRIANGLE_BITS) - 1)) < indices_size / 3);
+            covered++;
+          }
+        }
+
+        assert(covered > 0);
+        assert(difference <= 1);
+
+        csr_save_ppm("visibility_buffer_%05d.ppm", frame, &visibility);
+      }
+    }
+  }
+
+  {
+    /* The ids of the largest buffer stay below CSR_VISIBILITY_EMPTY, one draw more is rejected before rendering */
+    unsigned long limit = (1UL << (32 - CSR_VISIBILITY_TRIANGLE_BITS)) - 1;
+    unsigned long limit_memory_size = csr_command_buffer_memory_size(limit + 1);
+    void *limit_memory = malloc(limit_memory_size);
+    csr_command_buffer limit_buffer;
+    unsigned long draw;
+
+    if (!limit_memory || !csr_command_buffer_init(&limit_buffer, limit_memory, limit_memory_size))
+    {
+      return;
+    }
+
+    for (draw = 0; draw < limit; ++draw)
+    {
+      csr_record_render(&limit_buffer, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, matrices);
+    }
+
+    assert(limit_buffer.count == limit);
+    assert(csr_execute_visibility(&visibility, &limit_buffer));
+
+    assert(csr_record_render(&limit_buffer, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, matrices));
+    assert(!csr_execute_visibility(&visibility, &limit_buffer));
+
+    free(limit_memory);
+  }
+
+  free(memory_forward);
+  free(memory_visibility);
+  free(command_memory);
+  free(matrices);
+}
+
+static void csr_test_frustum_culling(void)
+{
+  int width = 800;
+  int height = 600;
+
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory_culled = malloc(memory_size);
+  void *memory_unculled = malloc(memory_size);
+
+  csr_context culled = {0};
+  csr_context unculled = {0};
+
+  /* A box containing everything always intersects the frustum, so nothing is culled and no fast path is taken */
+  float bounds_everything[6] = {-1000000.0f, -1000000.0f, -1000000.0f, 1000000.0f, 1000000.0f, 1000000.0f};
+  float bounds[6];
+  int classified[3] = {0, 0, 0};
+
+  if (!csr_init_model(&culled, memory_culled, memory_size, width, height) ||
+      !csr_init_model(&unculled, memory_unculled, memory_size, width, height))
+  {
+    return;
+  }
+
+  csr_mesh_bounds(bounds, 3, teddy_vertices, teddy_vertices_size);
+
+  {
+    /* Camera flying through a 8 x 8 grid of teddies */
+    v3 up = vm_v3(0.0f, 1.0f, 0.0f);
+    float cam_fov = 90.0f;
+
+    m4x4 projection = vm_m4x4_perspective(vm_radf(cam_fov), (float)width / (float)height, 0.1f, 1000.0f);
+
+    int frame, x, z;
+
+    for (frame = 0; frame < 10; ++frame)
+    {
+      v3 cam_position = vm_v3(10.0f, 5.0f, 200.0f - 40.0f * (float)frame);
+      v3 look_at_pos = vm_v3(10.0f + 20.0f * (float)(frame - 5), 0.0f, 150.0f - 40.0f * (float)frame);
+      m4x4 view = vm_m4x4_lookAt(cam_position, look_at_pos, up);
+      m4x4 projection_view = vm_m4x4_mul(projection, view);
+
+      csr_render_clear_screen(&culled, clear_color);
+      csr_render_clear_screen(&unculled, clear_color);
+
+      for (z = 0; z < 8; ++z)
+      {
+        for (x = 0; x < 8; ++x)
+        {
+          m4x4 model = vm_m4x4_translate(vm_m4x4_identity, vm_v3((float)x * 50.0f - 175.0f, 0.0f, (float)z * -50.0f + 175.0f));
+          m4x4 model_view_projection = vm_m4x4_mul(projection_view, model);
+
+          classified[csr_frustum_classify(&culled, model_view_projection.e, bounds)]++;
+        }
+      }
+
+      PERF_PROFILE_WITH_NAME({
+        for (z = 0; z < 8; ++z)
+        {
+          for (x = 0; x < 8; ++x)
+          {
+            m4x4 model = vm_m4x4_translate(vm_m4x4_identity, vm_v3((float)x * 50.0f - 175.0f, 0.0f, (float)z * -50.0f + 175.0f));
+            m4x4 model_view_projection = vm_m4x4_mul(projection_view, model);
+
+            csr_render_bounded(&unculled, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, model_view_projection.e, bounds_everything);
+          }
+        }
+      }, "csr_render_unculled");
+
+      PERF_PROFILE_WITH_NAME({
+        for (z = 0; z < 8; ++z)
+        {
+          for (x = 0; x < 8; ++x)
+          {
+            m4x4 model = vm_m4x4_translate(vm_m4x4_identity, vm_v3((float)x * 50.0f - 175.0f, 0.0f, (float)z * -50.0f + 175.0f));
+            m4x4 model_view_projection = vm_m4x4_mul(projection_view, model);
+
+            csr_render_bounded(&culled, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, model_view_projection.e, bounds);
+          }
+        }
+      }, "csr_render_culled");
+
+      /* Skipping meshes outside and the checks of meshes inside must not change the image */
+      assert(csr_test_same_image(&culled, &unculled));
+
+      csr_save_ppm("frustum_culling_%05d.ppm", frame, &culled);
+    }
+  }
+
+  /* The fly through sees teddies outside, crossing the border and inside the screen */
+  assert(classified[CSR_FRUSTUM_OUTSIDE] > 0);
+  assert(classified[CSR_FRUSTUM_INTERSECTS] > 0);
+  assert(classified[CSR_FRUSTUM_INSIDE] > 0);
+
+  free(memory_culled);
+  free(memory_unculled);
+}
+
+static void csr_test_occlusion_culling(void)
+{
+  int width = 800;
+  int height = 600;
+
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory_all = malloc(memory_size);
+  void *memory_culled = malloc(memory_size);
+
+  csr_context all = {0};
+  csr_context culled = {0};
+
+  float bounds[6];
+  int occluded = 0;
+  int visible = 0;
+
+  if (!csr_init_model(&all, memory_all, memory_size, width, height) ||
+      !csr_init_model(&culled, memory_culled, memory_size, width, height))
+  {
+    return;
+  }
+
+  csr_mesh_bounds(bounds, 3, teddy_vertices, teddy_vertices_size);
+
+  {
+    m4x4 projection_view = csr_test_projection_view(width, height, 50.0f);
+
+    int frame, x, y, z;
+
+    for (frame = 0; frame < 10; ++frame)
+    {
+      /* A wall in front of a 8 x 3 x 4 grid of small teddies, moving from left to right */
+      m4x4 wall = vm_m4x4_translate(vm_m4x4_scale(vm_m4x4_identity, vm_v3(50.0f, 30.0f, 1.0f)), vm_v3(-20.0f + 4.0f * (float)frame, -10.0f, 20.0f));
+      m4x4 wall_view_projection = vm_m4x4_mul(projection_view, wall);
+
+      csr_render_clear_screen(&all, clear_color);
+      csr_render_clear_screen(&culled, clear_color);
+
+      csr_render(&all, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 6, vertices, vertices_size, indices, indices_size, wall_view_projection.e);
+      csr_render(&culled, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 6, vertices, vertices_size, indices, indices_size, wall_view_projection.e);
+
+      /* Teddies are drawn near to far so that they also occlude each other */
+      for (z = 0; z < 4; ++z)
+      {
+        for (y = 0; y < 3; ++y)
+        {
+          for (x = 0; x < 8; ++x)
+          {
+            m4x4 model = vm_m4x4_translate(vm_m4x4_scalef(vm_m4x4_identity, 0.25f), vm_v3((float)x * 10.0f - 35.0f, (float)y * 12.0f - 15.0f, (float)z * -20.0f - 10.0f));
+            m4x4 model_view_projection = vm_m4x4_mul(projection_view, model);
+
+            csr_render(&all, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, model_view_projection.e);
+
+            if (!csr_occlusion_test_aabb(&culled, model_view_projection.e, &bounds[0], &bounds[3]))
+            {
+              occluded++;
+              continue;
+            }
+
+            visible++;
+            csr_render(&culled, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, model_view_projection.e);
+          }
+        }
+      }
+
+      /* Skipping the occluded teddies must not change the image */
+      assert(csr_test_same_image(&all, &culled));
+
+      csr_save_ppm("occlusion_culling_%05d.ppm", frame, &culled);
+    }
+  }
+
+  assert(occluded > 0);
+  assert(visible > 0);
+
+  printf("[csr] occlusion culling: %d teddies occluded, %d visible\n", occluded, visible);
+
+  free(memory_all);
+  free(memory_culled);
+}
+
+static void csr_test_occlusion_query(void)
+{
+  int width = 800;
+  int height = 600;
+
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory = malloc(memory_size);
+  float *zbuffer_before = (float *)malloc((size_t)(width * height) * sizeof(float));
+
+  csr_context context = {0};
+
+  int level;
+
+  if (!zbuffer_before || !csr_init_model(&context, memory, memory_size, width, height))
+  {
+    return;
+  }
+
+  for (level = CSR_SIMD_SCALAR; level <= CSR_SIMD_AVX2; ++level)
+  {
+    /* Skip levels that are not compiled in or not supported by this CPU */
+    if (csr_set_simd_level(&context, (csr_simd_level)level) != (csr_simd_level)level)
+    {
+      continue;
+    }
+
+    {
+      m4x4 projection_view = csr_test_projection_view(width, height, 50.0f);
+
+      m4x4 wall = vm_m4x4_translate(vm_m4x4_scale(vm_m4x4_identity, vm_v3(30.0f, 30.0f, 1.0f)), vm_v3_zero);
+      m4x4 wall_view_projection = vm_m4x4_mul(projection_view, wall);
+
+      m4x4 hidden = vm_m4x4_translate(vm_m4x4_scalef(vm_m4x4_identity, 10.0f), vm_v3(0.0f, 0.0f, -10.0f));
+      m4x4 hidden_view_projection = vm_m4x4_mul(projection_view, hidden);
+
+      int frame, i;
+
+      for (frame = 0; frame < 10; ++frame)
+      {
+        /* A rotating cube partly behind the top of the wall */
+        m4x4 model = vm_m4x4_rotate(vm_m4x4_translate(vm_m4x4_identity, vm_v3(-27.0f + 6.0f * (float)frame, 18.0f, -8.0f)), vm_radf(10.0f * (float)(frame + 1)), vm_v3(0.5f, 1.0f, 0.0f));
+        m4x4 model_view_projection = vm_m4x4_mul(projection_view, vm_m4x4_scale(model, vm_v3(12.0f, 12.0f, 12.0f)));
+        unsigned long samples, changed = 0;
+
+        /* Lines are counted as well */
+        csr_render_clear_screen(&context, clear_color);
+        csr_render(&context, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 6, vertices, vertices_size, indices, indices_size, wall_view_projection.e);
+        csr_occlusion_query_begin(&context);
+        csr_render(&context, CSR_RENDER_WIREFRAME, CSR_CULLING_DISABLED, 6, vertices, vertices_size, indices, indices_size, model_view_projection.e);
+        assert(csr_occlusion_query_end(&context) > 0);
+
+        csr_render_clear_screen(&context, clear_color);
+        csr_render(&context, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 6, vertices, vertices_size, indices, indices_size, wall_view_projection.e);
+
+        /* A cube entirely behind the wall passes nowhere */
+        csr_occlusion_query_begin(&context);
+        csr_render(&context, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, hidden_view_projection.e);
+        assert(csr_occlusion_query_end(&context) == 0);
+
+        memcpy(zbuffer_before, context.zbuffer, (size_t)(width * height) * sizeof(float));
+
+        csr_occlusion_query_begin(&context);
+        csr_render(&context, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, model_view_projection.e);
+        samples = csr_occlusion_query_end(&context);
+
+        /* The front faces of a cube do not overlap, so every sample lowered the depth of a different pixel */
+        for (i = 0; i < width * height; ++i)
+        {
+          changed += context.zbuffer[i] != zbuffer_before[i];
+        }
+
+        assert(samples > 0);
+        assert(samples == changed);
+
+        csr_save_ppm("occlusion_query_%05d.ppm", frame, &context);
+
+        /* Nothing is counted outside of a query */
+        csr_render(&context, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, model_view_projection.e);
+        csr_occlusion_query_begin(&context);
+        assert(csr_occlusion_query_end(&context) == 0);
+      }
+    }
+  }
+
+  free(memory);
+  free(zbuffer_before);
+}
+
+static void csr_test_meshlets_model(char *name, float *model_vertices, unsigned long num_vertices, int *model_indices, unsigned long num_indices, float scale)
+{
+  int width = 800;
+  int height = 600;
+
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory_meshlets = malloc(memory_size);
+  void *memory_mesh = malloc(memory_size);
+
+  unsigned long meshlets_max = csr_meshlets_max(num_indices);
+  csr_meshlet *meshlets = (csr_meshlet *)malloc(meshlets_max * sizeof(csr_meshlet));
+  int *meshlet_vertices = (int *)malloc(num_indices * sizeof(int));
+  unsigned char *meshlet_triangles = (unsigned char *)malloc(num_indices);
+  int *meshlet_indices = (int *)malloc(num_indices * sizeof(int));
+
+  csr_context meshlet = {0};
+  csr_context mesh = {0};
+
+  unsigned long meshlet_count, i, drawn_culled = 0, drawn_unculled = 0;
+  int k;
+
+  if (!meshlets || !meshlet_vertices || !meshlet_triangles || !meshlet_indices ||
+      !csr_init_model(&meshlet, memory_meshlets, memory_size, width, height) ||
+      !csr_init_model(&mesh, memory_mesh, memory_size, width, height))
+  {
+    return;
+  }
+
+  PERF_PROFILE_WITH_NAME({ meshlet_count = csr_meshlets_build(meshlets, meshlet_vertices, meshlet_triangles, 3, model_vertices, num_vertices, model_indices, num_indices); }, "csr_meshlets_build");
+
+  assert(meshlet_count > 0);
+  assert(meshlet_count <= meshlets_max);
+
+  /* The meshlets cover every triangle exactly once, in meshlet order */
+  for (i = 0; i < meshlet_count; ++i)
+  {
+    assert(meshlets[i].triangle_count > 0 && meshlets[i].triangle_count <= CSR_MESHLET_TRIANGLES);
+    assert(meshlets[i].vertex_count > 0 && meshlets[i].vertex_count <= CSR_MESHLET_VERTICES);
+    assert(i == 0 || meshlets[i].triangle_offset == meshlets[i - 1].triangle_offset + (unsigned long)meshlets[i - 1].triangle_count * 3);
+
+    for (k = 0; k < meshlets[i].triangle_count * 3; ++k)
+    {
+      meshlet_indices[meshlets[i].triangle_offset + (unsigned long)k] = meshlet_vertices[meshlets[i].vertex_offset + meshlet_triangles[meshlets[i].triangle_offset + (unsigned long)k]];
+    }
+  }
+
+  assert(meshlets[meshlet_count - 1].triangle_offset + (unsigned long)meshlets[meshlet_count - 1].triangle_count * 3 == num_indices);
+
+  {
+    m4x4 projection_view = csr_test_projection_view(width, height, 50.0f);
+
+    v3 rotation_axis = vm_v3(0.5f, 1.0f, 0.0f);
+
+    int frame;
+
+    for (frame = 0; frame < 10; ++frame)
+    {
+      /* The model rotates and moves to the left, partly leaving the frustum */
+      m4x4 model = vm_m4x4_rotate(vm_m4x4_translate(vm_m4x4_identity, vm_v3(-8.0f * (float)frame, 0.0f, 0.0f)), vm_radf(36.0f * (float)frame), rotation_axis);
+      m4x4 model_view_projection = vm_m4x4_mul(projection_view, vm_m4x4_scalef(model, scale));
+
+      /* Culling whole meshlets must give the same image as culling their triangles one by one */
+      csr_render_clear_screen(&meshlet, clear_color);
+      csr_render_clear_screen(&mesh, clear_color);
+      PERF_PROFILE_WITH_NAME({ drawn_culled += csr_render_meshlets(&meshlet, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 3, model_vertices, meshlets, meshlet_count, meshlet_vertices, meshlet_triangles, model_view_projection.e); }, "csr_render_meshlets");
+      PERF_PROFILE_WITH_NAME({ csr_render(&mesh, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 3, model_vertices, num_vertices, meshlet_indices, num_indices, model_view_projection.e); }, "csr_render");
+
+      assert(csr_test_same_image(&meshlet, &mesh));
+
+      csr_save_ppm("meshlets_%05d.ppm", frame, &meshlet);
+
+      /* The other side of the model */
+      csr_render_clear_screen(&meshlet, clear_color);
+      csr_render_clear_screen(&mesh, clear_color);
+      csr_render_meshlets(&meshlet, CSR_RENDER_SOLID, CSR_CULLING_CW_BACKFACE, 3, model_vertices, meshlets, meshlet_count, meshlet_vertices, meshlet_triangles, model_view_projection.e);
+      csr_render(&mesh, CSR_RENDER_SOLID, CSR_CULLING_CW_BACKFACE, 3, model_vertices, num_vertices, meshlet_indices, num_indices, model_view_projection.e);
+
+      assert(csr_test_same_image(&meshlet, &mesh));
+
+      /* Without culling only meshlets outside of the frustum are skipped */
+      csr_render_clear_screen(&meshlet, clear_color);
+      csr_render_clear_screen(&mesh, clear_color);
+      drawn_unculled += csr_render_meshlets(&meshlet, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, model_vertices, meshlets, meshlet_count, meshlet_vertices, meshlet_triangles, model_view_projection.e);
+      csr_render(&mesh, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, model_vertices, num_vertices, meshlet_indices, num_indices, model_view_projection.e);
+
+      assert(csr_test_same_image(&meshlet, &mesh));
+    }
+  }
+
+  assert(drawn_culled < drawn_unculled);
+  assert(drawn_unculled < meshlet_count * 10);
+
+  printf("[csr] meshlets %s: %lu meshlets, %lu drawn with culling, %lu without of %lu\n", name, meshlet_count, drawn_culled, drawn_unculled, meshlet_count * 10);
+
+  free(meshlets);
+  free(meshlet_vertices);
+  free(meshlet_triangles);
+  free(meshlet_indices);
+  free(memory_meshlets);
+  free(memory_mesh);
+}
+
+static void csr_test_meshlets(void)
+{
+  csr_test_meshlets_model("teddy", teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, 1.0f);
+  csr_test_meshlets_model("head", head_vertices, head_vertices_size, head_indices, head_indices_size, 80.0f);
+}
+
+static void csr_test_lod(void)
+{
+  int width = 800;
+  int height = 600;
+
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory = malloc(memory_size);
+
+  unsigned long simplify_memory_size = csr_simplify_memory_size(3, head_vertices_size, head_indices_size);
+  void *simplify_memory = malloc(simplify_memory_size);
+  int *lod_indices = (int *)malloc(csr_lods_indices_max(head_indices_size) * sizeof(int));
+
+  csr_context context = {0};
+  csr_lod lods[8];
+
+  unsigned long vertex_count = head_vertices_size / 3;
+  unsigned long i, covered[8];
+  int lod_count, lod, previous = 0;
+
+  if (!simplify_memory || !lod_indices || !csr_init_model(&context, memory, memory_size, width, height))
+  {
+    return;
+  }
+
+  PERF_PROFILE_WITH_NAME({ lod_count = csr_lods_build(lods, 8, lod_indices, 3, head_vertices, head_vertices_size, head_indices, head_indices_size, simplify_memory, simplify_memory_size); }, "csr_lods_build");
+
+  assert(lod_count >= 4);
+  assert(lods[0].index_count == head_indices_size);
+
+  for (lod = 0; lod < lod_count; ++lod)
+  {
+    int *triangles = &lod_indices[lods[lod].index_offset];
+
+    printf("[csr] lod %d: %lu triangles\n", lod, lods[lod].index_count / 3);
+
+    assert(lods[lod].index_count > 0 && lods[lod].index_count % 3 == 0);
+    assert(lod == 0 || lods[lod].index_count * 4 <= lods[lod - 1].index_count * 3);
+
+    /* Levels index the original vertices and contain no collapsed triangles */
+    for (i = 0; i < lods[lod].index_count; i += 3)
+    {
+      assert((unsigned long)triangles[i] < vertex_count && (unsigned long)triangles[i + 1] < vertex_count && (unsigned long)triangles[i + 2] < vertex_count);
+      assert(triangles[i] != triangles[i + 1] && triangles[i + 1] != triangles[i + 2] && triangles[i + 2] != triangles[i]);
+    }
+  }
+
+  {
+    m4x4 projection_view = csr_test_projection_view(width, height, 50.0f);
+
+    m4x4 model = vm_m4x4_rotate(vm_m4x4_scalef(vm_m4x4_identity, 120.0f), vm_radf(30.0f), vm_v3(0.0f, 1.0f, 0.0f));
+    m4x4 model_view_projection = vm_m4x4_mul(projection_view, model);
+
+    int frame;
+
+    /* The simplified levels keep the silhouette of the head */
+    for (lod = 0; lod < lod_count; ++lod)
+    {
+      csr_render_clear_screen(&context, clear_color);
+      csr_render(&context, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, head_vertices, head_vertices_size, &lod_indices[lods[lod].index_offset], lods[lod].index_count, model_view_projection.e);
+      csr_save_ppm("lod_%05d.ppm", lod, &context);
+
+      covered[lod] = 0;
+
+      for (i = 0; i < (unsigned long)(width * height); ++i)
+      {
+        covered[lod] += context.zbuffer[i] < 1.0f;
+      }
+
+      printf("[csr] lod %d: %lu pixels covered\n", lod, covered[lod]);
+
+      assert(covered[lod] * 5 >= covered[0] * 4);
+    }
+
+    /* Moving away the head gets coarser levels, each with about one triangle per CSR_LOD_PIXELS_PER_TRIANGLE pixels */
+    for (frame = 0; frame < 10; ++frame)
+    {
+      m4x4 distant = vm_m4x4_rotate(vm_m4x4_translate(vm_m4x4_identity, vm_v3(0.0f, 0.0f, -60.0f * (float)frame)), vm_radf(30.0f), vm_v3(0.0f, 1.0f, 0.0f));
+      m4x4 distant_view_projection = vm_m4x4_mul(projection_view, vm_m4x4_scalef(distant, 120.0f));
+
+      csr_render_clear_screen(&context, clear_color);
+      PERF_PROFILE_WITH_NAME({ lod = csr_render_lod(&context, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, head_vertices, head_vertices_size, lod_indices, lods, lod_count, distant_view_projection.e); }, "csr_render_lod");
+      csr_save_ppm("lod_distance_%05d.ppm", frame, &context);
+
+      printf("[csr] lod distance %d: level %d\n", frame, lod);
+
+      assert(lod >= previous);
+      previous = lod;
+    }
+
+    assert(previous > 0);
+  }
+
+  free(memory);
+  free(simplify_memory);
+  free(lod_indices);
+}
+
+static void csr_test_voxel_grid(void)
+{
+#define grid_voxel_x 101
+#define grid_voxel_y 101
+#define grid_voxel_z 101
+  unsigned char *voxels = malloc(grid_voxel_x * grid_voxel_y * grid_voxel_z);
+  float *matrices = malloc(grid_voxel_x * grid_voxel_y * grid_voxel_z * 16 * sizeof(float));
+
+  int width = 800;
+  int height = 600;
+
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory_cubes = malloc(memory_size);
+  void *memory_grid = malloc(memory_size);
+  void *memory_rays = malloc(memory_size);
+
+  csr_context cubes = {0};
+  csr_context grid = {0};
+  csr_context rays = {0};
+  csr_color voxel_color = {220, 180, 140};
+
+  if (!voxels || !matrices ||
+      !csr_init_model(&cubes, memory_cubes, memory_size, width, height) ||
+      !csr_init_model(&grid, memory_grid, memory_size, width, height) ||
+      !csr_init_model(&rays, memory_rays, memory_size, width, height))
+  {
+    return;
+  }
+
+  if (!mvx_voxelize_mesh(
+          head_vertices, head_vertices_size,
+          head_indices, head_indices_size,
+          grid_voxel_x, grid_voxel_y, grid_voxel_z,
+          2, 2, 2,
+          voxels))
+  {
+    printf("[mvx] voxelization failed!\n");
+    return;
+  }
+
+  {
+    m4x4 projection_view = csr_test_projection_view(width, height, grid_voxel_z);
+
+    int frame, x, y, z, i;
+
+    for (frame = 0; frame < 10; ++frame)
+    {
+      /* The grid spans [0, grid] in model space, center it on 0,0,0 */
+      m4x4 rotation = vm_m4x4_rotate(vm_m4x4_identity, vm_radf(20.0f * (float)(frame + 1)), vm_v3(0.0f, 1.0f, 0.0f));
+      m4x4 model = vm_m4x4_translate(rotation, vm_v3(-grid_voxel_x * 0.5f, -grid_voxel_y * 0.5f, -grid_voxel_z * 0.5f));
+      m4x4 model_view_projection = vm_m4x4_mul(projection_view, model);
+      unsigned long instance_count = 0;
+      int mismatches = 0;
+      int ray_mismatches = 0;
+
+      /* The same voxels drawn as cubes centered in their grid cells */
+      for (z = 0; z < grid_voxel_z; ++z)
+      {
+        for (y = 0; y < grid_voxel_y; ++y)
+        {
+          for (x = 0; x < grid_voxel_x; ++x)
+          {
+            if (voxels[x + y * grid_voxel_x + z * grid_voxel_x * grid_voxel_y])
+            {
+              m4x4 cube_model_view_projection = vm_m4x4_mul(model_view_projection, vm_m4x4_translate(vm_m4x4_identity, vm_v3((float)x + 0.5f, (float)y + 0.5f, (float)z + 0.5f)));
+
+              for (i = 0; i < 16; ++i)
+              {
+                matrices[instance_count * 16 + (unsigned long)i] = cube_model_view_projection.e[i];
+              }
+
+              ++instance_count;
+            }
+          }
+        }
+      }
+
+      csr_render_clear_screen(&cubes, clear_color);
+      csr_render_clear_screen(&grid, clear_color);
+      csr_render_clear_screen(&rays, clear_color);
+
+      PERF_PROFILE_WITH_NAME({ csr_render_instanced(&cubes, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, matrices, instance_count); }, "csr_render_voxel_cubes");
+      PERF_PROFILE_WITH_NAME({ csr_render_voxels(&grid, CSR_RENDER_SOLID, voxels, grid_voxel_x, grid_voxel_y, grid_voxel_z, voxel_color, model_view_projection.e); }, "csr_render_voxels");
+      PERF_PROFILE_WITH_NAME({ assert(csr_raycast_voxels(&rays, voxels, grid_voxel_x, grid_voxel_y, grid_voxel_z, voxel_color, model_view_projection.e)); }, "csr_raycast_voxels");
+
+      /* Both draw the same surface. Vertices are rounded differently, so pixels on edges where the surface
+       * steps back may show the face of a neighbor voxel a few voxels further away.
+       */
+      for (i = 0; i < width * height; ++i)
+      {
+        float difference = cubes.zbuffer[i] - grid.zbuffer[i];
+
+        if (difference > 0.001f || difference < -0.001f)
+        {
+          ++mismatches;
+        }
+
+        /* Rays sample the pixel centers like the rasterizer, so only pixels on voxel edges may differ */
+        difference = rays.zbuffer[i] - grid.zbuffer[i];
+
+        if (difference > 0.001f || difference < -0.001f)
+        {
+          ++ray_mismatches;
+        }
+      }
+
+      assert(mismatches < width * height / 1000);
+      assert(ray_mismatches < width * height / 1000);
+
+      csr_save_ppm("voxel_grid_%05d.ppm", frame, &grid);
+      csr_save_ppm("voxel_raycast_%05d.ppm", frame, &rays);
+    }
+  }
+
+  {
+    /* A solid 4 x 4 x 4 grid turned so the camera looks along its x, y and z axis shows the color of the faces
+     * perpendicular to that axis. The last frame places the camera inside the grid, the rays start in a set voxel
+     * (t_enter = 0) and show the z face color.
+     */
+    unsigned char solid[4 * 4 * 4];
+    csr_color colors[3];
+    m4x4 projection_view = csr_test_projection_view(width, height, 10.0f);
+    m4x4 centered = vm_m4x4_translate(vm_m4x4_identity, vm_v3(-2.0f, -2.0f, -2.0f));
+    m4x4 models[4];
+    int frame, x, y, i;
+
+    for (i = 0; i < 4 * 4 * 4; ++i)
+    {
+      solid[i] = 1;
+    }
+
+    csr_voxel_colors(colors, voxel_color);
+
+    models[0] = vm_m4x4_mul(vm_m4x4_rotate(vm_m4x4_identity, vm_radf(90.0f), vm_v3(0.0f, 1.0f, 0.0f)), centered);
+    models[1] = vm_m4x4_mul(vm_m4x4_rotate(vm_m4x4_identity, vm_radf(90.0f), vm_v3(1.0f, 0.0f, 0.0f)), centered);
+    models[2] = centered;
+    models[3] = vm_m4x4_translate(vm_m4x4_identity, vm_v3(-2.0f, -2.0f, 8.0f));
+
+    for (frame = 0; frame < 4; ++frame)
+    {
+      m4x4 model_view_projection = vm_m4x4_mul(projection_view, models[frame]);
+      csr_color face_color = colors[frame < 3 ? frame : 2];
+      float clear_depth;
+
+      csr_render_clear_screen(&rays, clear_color);
+      clear_depth = rays.zbuffer[0];
+
+      assert(csr_raycast_voxels(&rays, solid, 4, 4, 4, voxel_color, model_view_projection.e));
+
+      /* The pixels around the screen center are far from the edges of the face */
+      for (y = height / 2 - 20; y < height / 2 + 20; ++y)
+      {
+        for (x = width / 2 - 20; x < width / 2 + 20; ++x)
+        {
+          assert(memcmp(&rays.framebuffer[y * width + x], &face_color, sizeof(csr_color)) == 0);
+          assert(rays.zbuffer[y * width + x] < clear_depth);
+        }
+      }
+
+      if (frame < 3)
+      {
+        /* The rays of the screen corners miss the grid and leave the pixels untouched */
+        assert(memcmp(&rays.framebuffer[0], &clear_color, sizeof(csr_color)) == 0);
+        assert(memcmp(&rays.framebuffer[width * height - 1], &clear_color, sizeof(csr_color)) == 0);
+        assert(rays.zbuffer[width * height - 1] == clear_depth);
+      }
+      else
+      {
+        for (i = 0; i < width * height; ++i)
+        {
+          assert(memcmp(&rays.framebuffer[i], &face_color, sizeof(csr_color)) == 0);
+        }
+      }
+
+      csr_save_ppm("voxel_raycast_faces_%05d.ppm", frame, &rays);
+    }
+  }
+
+  free(memory_cubes);
+  free(memory_grid);
+  free(memory_rays);
+  free(matrices);
+  free(voxels);
+}
+
+static void csr_test_timings(void)
+{
+  int width = 800;
+  int height = 600;
+
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory_timed = malloc(memory_size);
+  void *memory_plain = malloc(memory_size);
+
+  csr_context timed = {0};
+  csr_context plain = {0};
+
+  char *stage_names[CSR_STAGE_COUNT] = {"csr_stage_transform", "csr_stage_cull", "csr_stage_setup", "csr_stage_raster", "csr_stage_lines"};
+
+  if (!csr_init_model(&timed, memory_timed, memory_size, width, height) ||
+      !csr_init_model(&plain, memory_plain, memory_size, width, height))
+  {
+    return;
+  }
+
+  timed.timer = perf_platform_current_cycle_count;
+
+  {
+    m4x4 projection_view = csr_test_projection_view(width, height, 50.0f);
+
+    m4x4 cube_view_projection = vm_m4x4_mul(projection_view, vm_m4x4_scale(vm_m4x4_identity, vm_v3(15.0f, 15.0f, 15.0f)));
+
+    int frame;
+
+    for (frame = 0; frame < 10; ++frame)
+    {
+      m4x4 teddy_view_projection = vm_m4x4_mul(projection_view, vm_m4x4_rotate(vm_m4x4_identity, vm_radf(10.0f * (float)frame), vm_v3(0.0f, 1.0f, 0.0f)));
+
+      unsigned long frame_cycles, stage_sum = 0;
+      double frame_ms;
+      int stage;
+
+      csr_timings_reset(&timed);
+
+      /* The same frame once with and once without timing */
+      {
+        unsigned long perf_start_cycles, perf_end_cycles;
+        double perf_start_time_nano, perf_end_time_nano;
+
+        perf_start_time_nano = perf_platform_current_time_nanoseconds();
+        perf_start_cycles = perf_platform_current_cycle_count();
+
+        csr_render_clear_screen(&timed, clear_color);
+        csr_render(&timed, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, teddy_view_projection.e);
+        csr_render(&timed, CSR_RENDER_WIREFRAME, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, cube_view_projection.e);
+
+        perf_end_cycles = perf_platform_current_cycle_count();
+        perf_end_time_nano = perf_platform_current_time_nanoseconds();
+
+        frame_cycles = perf_end_cycles - perf_start_cycles;
+        frame_ms = (perf_end_time_nano - perf_start_time_nano) / 1000000.0;
+      }
+
+      csr_render_clear_screen(&plain, clear_color);
+      csr_render(&plain, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, teddy_view_projection.e);
+      csr_render(&plain, CSR_RENDER_WIREFRAME, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, cube_view_projection.e);
+
+      /* Report the stages as parts of the measured frame time */
+      for (stage = 0; stage < CSR_STAGE_COUNT; ++stage)
+      {
+        unsigned long cycles = timed.stage_cycles[stage];
+        double time_ms = frame_cycles ? frame_ms * (double)cycles / (double)frame_cycles : 0.0;
+
+        perf_print_result(__FILE__, __LINE__, cycles, time_ms, stage_names[stage]);
+        perf_stats_store_result(__FILE__, __LINE__, cycles, time_ms, stage_names[stage]);
+
+        stage_sum += cycles;
+      }
+
+      /* Every stage of the frame was timed and the stages do not overlap */
+      assert(!timed.timer_active);
+      assert(timed.stage_cycles[CSR_STAGE_TRANSFORM] > 0);
+      assert(timed.stage_cycles[CSR_STAGE_CULL] > 0);
+      assert(timed.stage_cycles[CSR_STAGE_SETUP] > 0);
+      assert(timed.stage_cycles[CSR_STAGE_RASTER] > 0);
+      assert(timed.stage_cycles[CSR_STAGE_LINES] > 0);
+      assert(stage_sum <= frame_cycles);
+
+      /* Timing does not change the image and nothing is timed without a timer */
+      assert(memcmp(timed.framebuffer, plain.framebuffer, (unsigned long)(width * height) * sizeof(csr_color)) == 0);
+
+      for (stage = 0; stage < CSR_STAGE_COUNT; ++stage)
+      {
+        assert(plain.stage_cycles[stage] == 0);
+      }
+    }
+  }
+
+  free(memory_timed);
+  free(memory_plain);
+}
+
+static void csr_test_overdraw(void)
+{
+  int width = 800;
+  int height = 600;
+
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory = malloc(memory_size);
+
+  csr_context context = {0};
+
+  /* A square in the xy plane */
+  float quad_vertices[] = {-1.0f, -1.0f, 0.0f, 1.0f, -1.0f, 0.0f, 1.0f, 1.0f, 0.0f, -1.0f, 1.0f, 0.0f};
+  int quad_indices[] = {0, 1, 2, 0, 2, 3};
+
+  unsigned int *overdraw;
+  unsigned long *tile_cycles;
+  csr_color *image;
+
+  if (!csr_init_model(&context, memory, memory_size, width, height))
+  {
+    return;
+  }
+
+  context.timer = perf_platform_current_cycle_count;
+
+  overdraw = (unsigned int *)malloc((unsigned long)(width * height) * sizeof(unsigned int));
+  tile_cycles = (unsigned long *)malloc((unsigned long)(context.tiles_x * context.tiles_y) * sizeof(unsigned long));
+  image = (csr_color *)malloc((unsigned long)(width * height) * sizeof(csr_color));
+
+  if (!overdraw || !tile_cycles || !image)
+  {
+    return;
+  }
+
+  {
+    m4x4 projection_view = csr_test_projection_view(width, height, 50.0f);
+
+    m4x4 quad_view_projection = vm_m4x4_mul(projection_view, vm_m4x4_scale(vm_m4x4_identity, vm_v3(10.0f, 10.0f, 1.0f)));
+    m4x4 cube_view_projection = vm_m4x4_mul(projection_view, vm_m4x4_scale(vm_m4x4_identity, vm_v3(15.0f, 15.0f, 15.0f)));
+
+    unsigned long samples, sum = 0, tested = 0, mismatched = 0;
+    unsigned int max_overdraw = 0;
+    int busy_tiles = 0, idle_tiles = 0;
+    int teddy, i;
+
+    /* Every covered pixel of a visible square is tested once, drawing it again tests them a second time */
+    csr_render_clear_screen(&context, clear_color);
+    csr_debug_begin(&context, overdraw, 0);
+
+    csr_occlusion_query_begin(&context);
+    csr_render(&context, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, quad_vertices, 12, quad_indices, 6, quad_view_projection.e);
+    samples = csr_occlusion_query_end(&context);
+
+    for (i = 0; i < width * height; ++i)
+    {
+      sum += overdraw[i];
+      tested += overdraw[i] != 0;
+      mismatched += (overdraw[i] != 0) != (memcmp(&context.framebuffer[i], &clear_color, sizeof(csr_color)) != 0);
+    }
+
+    /* Pixels are counted exactly where the square was drawn */
+    assert(mismatched == 0);
+    assert(samples > 0);
+    assert(sum == samples);
+    assert(tested == samples);
+
+    csr_occlusion_query_begin(&context);
+    csr_render(&context, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, quad_vertices, 12, quad_indices, 6, quad_view_projection.e);
+    assert(csr_occlusion_query_end(&context) == 0);
+
+    csr_debug_end(&context);
+
+    for (i = 0, sum = 0; i < width * height; ++i)
+    {
+      sum += overdraw[i];
+    }
+
+    assert(sum == 2 * samples);
+    assert(context.overdraw == 0);
+
+    /* Teddies behind each other without culling and a wireframe cube */
+    csr_render_clear_screen(&context, clear_color);
+    csr_debug_begin(&context, overdraw, tile_cycles);
+
+    for (teddy = 0; teddy < 4; ++teddy)
+    {
+      m4x4 model = vm_m4x4_rotate(vm_m4x4_translate(vm_m4x4_identity, vm_v3(3.0f * (float)teddy, 0.0f, -10.0f * (float)teddy)), vm_radf(20.0f), vm_v3(0.0f, 1.0f, 0.0f));
+      m4x4 teddy_view_projection = vm_m4x4_mul(projection_view, model);
+
+      csr_render(&context, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, teddy_view_projection.e);
+    }
+
+    csr_render(&context, CSR_RENDER_WIREFRAME, CSR_CULLING_CCW_BACKFACE, 6, vertices, vertices_size, indices, indices_size, cube_view_projection.e);
+
+    csr_debug_end(&context);
+
+    for (i = 0; i < width * height; ++i)
+    {
+      max_overdraw = overdraw[i] > max_overdraw ? overdraw[i] : max_overdraw;
+    }
+
+    for (i = 0; i < context.tiles_x * context.tiles_y; ++i)
+    {
+      busy_tiles += tile_cycles[i] != 0;
+      idle_tiles += tile_cycles[i] == 0;
+    }
+
+    printf("[csr] overdraw: max. %u per pixel, %d tiles rasterized, %d empty\n", max_overdraw, busy_tiles, idle_tiles);
+
+    assert(max_overdraw > 2);
+    assert(busy_tiles > 0);
+    assert(idle_tiles > 0);
+
+    /* The heatmaps next to the frame */
+    csr_save_ppm("overdraw_frame_%05d.ppm", 0, &context);
+
+    csr_heatmap_overdraw(&context, image, overdraw);
+    csr_save_ppm_image("overdraw_heatmap_%05d.ppm", 0, width, height, image);
+
+    csr_heatmap_tile_cycles(&context, image, tile_cycles);
+    csr_save_ppm_image("overdraw_tile_cycles_%05d.ppm", 0, width, height, image);
+  }
+
+  free(overdraw);
+  free(tile_cycles);
+  free(image);
+  free(memory);
+}
+
+static void csr_test_fast_clear(void)
+{
+  /* Odd size: partial tiles at the borders and a zbuffer that is not 4 byte aligned */
+  int width = 803;
+  int height = 601;
+
+  unsigned long memory_size_plain = csr_memory_size_buffers(width, height);
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory_plain = malloc(memory_size_plain);
+  void *memory_cleared = malloc(memory_size);
+  void *memory_fast = malloc(memory_size);
+
+  csr_context plain = {0};
+  csr_context cleared = {0};
+  csr_context fast = {0};
+
+  if (!csr_init_model(&plain, memory_plain, memory_size_plain, width, height) ||
+      !csr_init_model(&cleared, memory_cleared, memory_size, width, height) ||
+      !csr_init_model(&fast, memory_fast, memory_size, width, height))
+  {
+    return;
+  }
+
+  /* Without binning memory there are no tile flags and the screen is cleared right away */
+  csr_render_clear_screen_fast(&plain, clear_color);
+  assert(plain.clear_pending == 0);
+  assert(plain.zbuffer[width * height - 1] == 1.0f);
+
+  {
+    m4x4 projection_view = csr_test_projection_view(width, height, 50.0f);
+
+    v3 rotation_axis = vm_v3(0.5f, 1.0f, 0.0);
+    m4x4 model_base = vm_m4x4_translate(vm_m4x4_identity, vm_v3_zero);
+
+    int frame, tile, pending;
+
+    for (frame = 0; frame < 10; ++frame)
+    {
+      m4x4 model = vm_m4x4_rotate(model_base, vm_radf(5.0f * (float)(frame + 1)), rotation_axis);
+      m4x4 model_view_projection = vm_m4x4_mul(projection_view, vm_m4x4_scale(model, vm_v3(0.5f, 0.5f, 0.5f)));
+      csr_color frame_color = csr_init_color((unsigned char)(frame * 20), 40, 60);
+      csr_color line_color = csr_init_color(255, 255, 0);
+      float p0[3] = {10.0f, 20.0f, 0.5f};
+      float p1[3] = {700.0f, 580.0f, 0.5f};
+
+      /* The clear color changes every frame, so a tile keeping the last frame would show up */
+      csr_render_clear_screen(&cleared, frame_color);
+      PERF_PROFILE_WITH_NAME({ csr_render_clear_screen_fast(&fast, frame_color); }, "csr_clear_screen_fast");
+
+      csr_render(&cleared, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, model_view_projection.e);
+      csr_render(&fast, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, model_view_projection.e);
+
+      csr_draw_line(&cleared, p0, p1, line_color);
+      csr_draw_line(&fast, p0, p1, line_color);
+
+      /* Only the tiles drawn to are filled, the small teddy and the line leave most of the screen untouched */
+      pending = 0;
+
+      for (tile = 0; tile < fast.tiles_x * fast.tiles_y; ++tile)
+      {
+        pending += fast.clear_tiles[tile];
+      }
+
+      assert(fast.clear_pending == 1);
+      assert(pending > 0 && pending < fast.tiles_x * fast.tiles_y);
+
+      PERF_PROFILE_WITH_NAME({ csr_render_resolve(&fast); }, "csr_render_resolve");
+      assert(fast.clear_pending == 0);
+
+      assert(csr_test_same_image(&cleared, &fast));
+    }
+  }
+
+  free(memory_plain);
+  free(memory_cleared);
+  free(memory_fast);
+}
+
+#ifdef CSR_ENABLE_STATS
+static void csr_test_stats(void)
+{
+  int width = 800;
+  int height = 600;
+
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory = malloc(memory_size);
+
+  csr_context context = {0};
+  csr_stats scalar = {0};
+
+  int level;
+
+  if (!csr_init_model(&context, memory, memory_size, width, height))
+  {
+    return;
+  }
+
+  for (level = CSR_SIMD_SCALAR; level <= CSR_SIMD_AVX2; ++level)
+  {
+    /* Skip levels that are not compiled in or not supported by this CPU */
+    if (csr_set_simd_level(&context, (csr_simd_level)level) != (csr_simd_level)level)
+    {
+      continue;
+    }
+
+    {
+      m4x4 projection_view = csr_test_projection_view(width, height, 50.0f);
+
+      m4x4 wall = vm_m4x4_translate(vm_m4x4_scale(vm_m4x4_identity, vm_v3(20.0f, 20.0f, 1.0f)), vm_v3(-10.0f, 0.0f, 10.0f));
+      m4x4 wall_view_projection = vm_m4x4_mul(projection_view, wall);
+
+      /* Teddies next to each other, the last one behind the camera and one outside of the frustum */
+      m4x4 teddy_view_projection[4];
+      m4x4 outside_view_projection = vm_m4x4_mul(projection_view, vm_m4x4_translate(vm_m4x4_identity, vm_v3(0.0f, 500.0f, 0.0f)));
+
+      csr_stats stats;
+      unsigned long samples, areas = 0;
+      int teddy, bin;
+
+      for (teddy = 0; teddy < 4; ++teddy)
+      {
+        m4x4 model = vm_m4x4_rotate(vm_m4x4_translate(vm_m4x4_identity, vm_v3(-30.0f + 20.0f * (float)teddy, 0.0f, teddy == 3 ? 40.0f : 0.0f)), vm_radf(30.0f), vm_v3(0.0f, 1.0f, 0.0f));
+        teddy_view_projection[teddy] = vm_m4x4_mul(projection_view, model);
+      }
+
+      csr_render_clear_screen(&context, clear_color);
+      csr_stats_reset(&context);
+      csr_occlusion_query_begin(&context);
+
+      csr_render(&context, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 6, vertices, vertices_size, indices, indices_size, wall_view_projection.e);
+
+      for (teddy = 0; teddy < 4; ++teddy)
+      {
+        csr_render(&context, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, teddy_view_projection[teddy].e);
+      }
+
+      /* A mesh entirely outside of the frustum */
+      csr_render(&context, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, outside_view_projection.e);
+
+      samples = csr_occlusion_query_end(&context);
+      csr_stats_collect(&context, &stats);
+
+      for (bin = 0; bin < CSR_STATS_AREA_BINS; ++bin)
+      {
+        areas += stats.triangle_areas[bin];
+      }
+
+      printf("[csr] stats: meshes %lu (%lu culled), triangles %lu: %lu w rejected, %lu culled, %lu degenerate, %lu off screen, %lu rasterized\n",
+             stats.meshes_submitted, stats.meshes_culled, stats.triangles_submitted, stats.triangles_w_rejected, stats.triangles_culled,
+             stats.triangles_degenerate, stats.triangles_offscreen, stats.triangles_rasterized);
+      printf("[csr] stats: pixels %lu bbox, %lu visited, %lu covered, %lu passed, %lu written\n",
+             stats.pixels_bbox, stats.pixels_visited, stats.pixels_covered, stats.pixels_passed, stats.pixels_written);
+
+      /* Every submitted triangle ends up in exactly one of the triangle counters */
+      assert(stats.meshes_submitted == 6);
+      assert(stats.meshes_culled == 1);
+      assert(stats.triangles_submitted == indices_size / 3 + 4 * (teddy_indices_size / 3));
+      assert(stats.triangles_submitted == stats.triangles_w_rejected + stats.triangles_culled + stats.triangles_degenerate + stats.triangles_offscreen + stats.triangles_rasterized);
+      assert(stats.triangles_w_rejected > 0);
+      assert(stats.triangles_culled > 0);
+      assert(stats.triangles_rasterized == areas);
+
+      /* Each pixel stage only sees pixels that passed the previous one */
+      assert(stats.pixels_bbox >= stats.pixels_visited);
+      assert(stats.pixels_visited >= stats.pixels_covered);
+      assert(stats.pixels_covered > stats.pixels_passed);
+      assert(stats.pixels_passed == samples);
+      assert(stats.pixels_written == stats.pixels_passed);
+
+      /* A depth only pass writes no colors */
+      csr_stats_reset(&context);
+      csr_render(&context, CSR_RENDER_DEPTH_ONLY, CSR_CULLING_DISABLED, 6, vertices, vertices_size, indices, indices_size, wall_view_projection.e);
+      csr_stats_collect(&context, &stats);
+
+      assert(stats.pixels_written == 0);
+
+      /* The pixel counters do not depend on the SIMD level */
+      csr_stats_reset(&context);
+      csr_render_clear_screen(&context, clear_color);
+      csr_render(&context, CSR_RENDER_SOLID, CSR_CULLING_CCW_BACKFACE, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, teddy_view_projection[1].e);
+      csr_stats_collect(&context, &stats);
+
+      if (level == CSR_SIMD_SCALAR)
+      {
+        scalar = stats;
+      }
+
+      assert(memcmp(&stats, &scalar, sizeof(csr_stats)) == 0);
+    }
+  }
+
+  free(memory);
+}
+#endif
+
+#ifdef CSR_USE_PTHREADS
+static void csr_test_threads(void)
+{
+  int width = 800;
+  int height = 600;
+
+  unsigned long memory_size = csr_memory_size(width, height);
+  void *memory_single = malloc(memory_size);
+  void *memory_threaded = malloc(memory_size);
+
+  csr_context single = {0};
+  csr_context threaded = {0};
+
+  if (!csr_init_model(&single, memory_single, memory_size, width, height) ||
+      !csr_init_model(&threaded, memory_threaded, memory_size, width, height) ||
+      !csr_threads_init(&threaded, 4))
+  {
+    return;
+  }
+
+  {
+    m4x4 projection_view = csr_test_projection_view(width, height, 50.0f);
+
+    v3 rotation_axis = vm_v3(0.5f, 1.0f, 0.0);
+    m4x4 model_base = vm_m4x4_translate(vm_m4x4_identity, vm_v3_zero);
+
+    int frame;
+
+    for (frame = 0; frame < 10; ++frame)
+    {
+      m4x4 model = vm_m4x4_rotate(model_base, vm_radf(5.0f * (float)(frame + 1)), rotation_axis);
+      m4x4 model_view_projection = vm_m4x4_mul(projection_view, model);
+
+      csr_render_clear_screen(&single, clear_color);
+      csr_render_clear_screen(&threaded, clear_color);
+
+      PERF_PROFILE_WITH_NAME({ csr_render(&single, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, model_view_projection.e); }, "csr_render_single_thread");
+      PERF_PROFILE_WITH_NAME({ csr_render(&threaded, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, model_view_projection.e); }, "csr_render_threaded");
+
+      /* Samples counted by the worker threads add up to the single threaded count */
+      csr_occlusion_query_begin(&single);
+      csr_occlusion_query_begin(&threaded);
+      csr_render(&single, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, model_view_projection.e);
+      csr_render(&threaded, CSR_RENDER_SOLID, CSR_CULLING_DISABLED, 3, teddy_vertices, teddy_vertices_size, teddy_indices, teddy_indices_size, model_view_projection.e);
+      assert(csr_occlusion_query_end(&single) == csr_occlusion_query_end(&threaded));
+
+      /* The threaded output must be identical to the single threaded one */
+      assert(csr_test_same_image(&single, &threaded));
+    }
+  }
+
+  csr_threads_shutdown(&threaded);
+
+  free(memory_single);
+  free(memory_threaded);
+}
+#endif
+
 int main(void)
 {
 
+  csr_test_fill_rule();
   csr_test_stack_alloc();
   csr_test_cube_scene_with_memory_alloc();
   csr_test_teddy();
   csr_test_voxelize_teddy();
   csr_test_voxelize_head();
+  csr_test_simd_levels();
+  csr_test_hierarchical_depth();
+  csr_test_depth_prepass();
+  csr_test_instanced();
+  csr_test_command_buffer();
+  csr_test_visibility_buffer();
+  csr_test_frustum_culling();
+  csr_test_occlusion_culling();
+  csr_test_occlusion_query();
+  csr_test_meshlets();
+  csr_test_lod();
+  csr_test_voxel_grid();
+
+  csr_test_timings();
+  csr_test_overdraw();
+  csr_test_fast_clear();
+
+#ifdef CSR_ENABLE_STATS
+  csr_test_stats();
+#endif
+
+#ifdef CSR_USE_PTHREADS
+  csr_test_threads();
+#endif
 
   return 0;
 }